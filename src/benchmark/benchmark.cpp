@@ -0,0 +1,467 @@
+/*
+ * QHexEd - Simple Qt Based Hex Editor
+ *
+ * Copyright (C) 2007 Nikita Sadkov
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * This code is free software.  You may redistribute copies of it under the terms of
+ * the GNU General Public License <http://www.gnu.org/licenses/gpl.html>.
+ * There is NO WARRANTY, to the extent permitted by law.
+*/
+
+#include "qhexed.h"
+
+
+// "qhexed-benchmark [file]" runs these and writes results as JSON,
+// so numbers from different builds can be compared
+class HexBenchmark {
+public:
+    QByteArray run();
+
+private:
+    void cacheHit();
+    void cacheMiss();
+    void cacheWrite();
+    void modelRead(const QString &name, HexDataModel &model);
+    void bufferStorm();
+    void save();
+    void search();
+    void paint();
+
+    void report(const QString &name, qint64 iterations, qint64 bytes, qint64 nsecs,
+                const QString &extra = QString());
+
+    QStringList mResults;
+};
+
+
+// settings written by benchmarks take effect as when set in settings panel
+static void applySettings() {
+    QSettings().sync();
+    HexSettings::instance()->emitChanged();
+    qApp->processEvents();
+}
+
+QByteArray HexBenchmark::run() {
+    mResults.clear();
+    mResults.append(QString("{\"name\": \"cache/selftest\", \"passed\": %1}")
+                    .arg(HexCache::selfTest() ? "true" : "false"));
+
+    cacheHit();
+    cacheMiss();
+    cacheWrite();
+
+    const int modelSize = 32*1024*1024;
+    QByteArray data(modelSize, 0);
+    for(int i = 0; i < modelSize; i++)
+        data[i] = (char)qrand();
+
+    QTemporaryFile *tmp = new QTemporaryFile;
+    tmp->open();
+    tmp->write(data);
+    tmp->flush();
+    HexFile file(tmp); // takes ownership of tmp
+    modelRead("HexFile", file);
+
+    HexBuffer buffer;
+    for(int i = 0; i < 32; i++)
+        buffer.paste(buffer.getLength(), data.mid(i*1024*1024, 1024*1024));
+    modelRead("HexBuffer", buffer);
+
+    HexStaticBuffer staticBuffer((uint8_t*)data.data(), modelSize);
+    modelRead("HexStaticBuffer", staticBuffer);
+
+    bufferStorm();
+    save();
+    search();
+    paint();
+
+    QByteArray json;
+    json += "{\n";
+    json += QString("  \"version\": \"0x%1\",\n").arg(HEX_VERSION, 8, 16, QChar('0')).toLatin1();
+    json += QString("  \"qt\": \"%1\",\n").arg(qVersion()).toLatin1();
+    json += "  \"results\": [\n    ";
+    json += mResults.join(",\n    ").toLatin1();
+    json += "\n  ]\n}\n";
+    return json;
+}
+
+void HexBenchmark::report(const QString &name, qint64 iterations, qint64 bytes, qint64 nsecs,
+                          const QString &extra) {
+    if(nsecs < 1) nsecs = 1;
+    QString result = QString("{\"name\": \"%1\", \"iterations\": %2, \"bytes\": %3, "
+                             "\"nsecs\": %4, \"nsPerOp\": %5, \"mbPerSec\": %6")
+        .arg(name).arg(iterations).arg(bytes).arg(nsecs)
+        .arg((double)nsecs/qMax(iterations, (qint64)1), 0, 'f', 2)
+        .arg(bytes/1048576.0/(nsecs/1e9), 0, 'f', 2);
+    if(!extra.isEmpty())
+        result += ", " + extra;
+    mResults.append(result + "}");
+}
+
+void HexBenchmark::cacheHit() {
+    const int size = 1024*1024;
+    QByteArray data(size, 0x55);
+    HexStaticBuffer model((uint8_t*)data.data(), size);
+    HexCache cache(model, 2*size);
+    for(int i = 0; i < size; i++) cache.getByte(i); // warm up
+
+    const int passes = 16;
+    int sum = 0;
+    QElapsedTimer timer;
+    timer.start();
+    for(int pass = 0; pass < passes; pass++)
+        for(int i = 0; i < size; i++)
+            sum += cache.getByte(i);
+    qint64 nsecs = timer.nsecsElapsed();
+    report("cache/hit", (qint64)passes*size, (qint64)passes*size, nsecs,
+           QString("\"checksum\": %1").arg(sum));
+}
+
+void HexBenchmark::cacheMiss() {
+    const int size = 32*1024*1024;
+    QByteArray data(size, 0x55);
+    HexStaticBuffer model((uint8_t*)data.data(), size);
+    HexCache cache(model, 3*1024, 1024); // three pages, so nearly every lookup misses
+
+    const int lookups = 200000;
+    int sum = 0;
+    QElapsedTimer timer;
+    timer.start();
+    for(int i = 0; i < lookups; i++)
+        sum += cache.getByte((((OffType)qrand()<<15) ^ qrand()) % size);
+    qint64 nsecs = timer.nsecsElapsed();
+    report("cache/miss", lookups, (qint64)cache.stats().misses*cache.pageSize(), nsecs,
+           QString("\"misses\": %1, \"checksum\": %2").arg(cache.stats().misses).arg(sum));
+}
+
+void HexBenchmark::cacheWrite() {
+    const int size = 1024*1024;
+    QByteArray data(size, 0);
+    HexStaticBuffer model((uint8_t*)data.data(), size);
+    HexCache cache(model, 64*1024);
+
+    const int writes = 200000;
+    QElapsedTimer timer;
+    timer.start();
+    for(int i = 0; i < writes; i++)
+        cache.putByte((((OffType)qrand()<<15) ^ qrand()) % size, (uint8_t)i);
+    cache.flush();
+    qint64 nsecs = timer.nsecsElapsed();
+    report("cache/write", writes, cache.stats().bytesWritten, nsecs,
+           QString("\"modelWrites\": %1, \"writeAmplification\": %2")
+           .arg(cache.stats().writes).arg(cache.stats().writeAmplification(), 0, 'f', 3));
+}
+
+void HexBenchmark::modelRead(const QString &name, HexDataModel &model) {
+    OffType length = model.getLength();
+    QByteArray block(64*1024, 0);
+
+    QElapsedTimer timer;
+    timer.start();
+    for(OffType offset = 0; offset < length; offset += block.size())
+        model.read(block.data(), offset, qMin((OffType)block.size(), length-offset));
+    report(name + "/sequential", (length+block.size()-1)/block.size(), length, timer.nsecsElapsed());
+
+    const int reads = 20000;
+    const int readSize = 4096;
+    timer.restart();
+    for(int i = 0; i < reads; i++) {
+        OffType offset = (((OffType)qrand()<<15) ^ qrand()) % (length-readSize);
+        model.read(block.data(), offset, readSize);
+    }
+    report(name + "/random", reads, (qint64)reads*readSize, timer.nsecsElapsed());
+}
+
+void HexBenchmark::bufferStorm() {
+    HexBuffer buffer;
+    for(int i = 0; i < 16; i++)
+        buffer.paste(buffer.getLength(), QByteArray(1024*1024, (char)i));
+
+    const int ops = 5000;
+    QByteArray piece(8, 0x11);
+    QElapsedTimer timer;
+    timer.start();
+    for(int i = 0; i < ops; i++) {
+        OffType where = (((OffType)qrand()<<15) ^ qrand()) % buffer.getLength();
+        if(i&1) buffer.del(where, where+piece.size());
+        else buffer.paste(where, piece);
+    }
+    report("HexBuffer/insertDeleteStorm", ops, (qint64)ops*piece.size(), timer.nsecsElapsed());
+}
+
+void HexBenchmark::save() {
+    const int size = 8*1024*1024;
+    HexDocument doc(new HexBuffer(QByteArray(size, 0x33)));
+    QTemporaryFile tmp;
+    tmp.open();
+
+    QElapsedTimer timer;
+    timer.start();
+    doc.saveFile(tmp.fileName());
+    report("HexDocument/save", 1, size, timer.nsecsElapsed());
+}
+
+void HexBenchmark::search() {
+    const int size = 64*1024*1024;
+    QByteArray data(size, 0);
+    for(int i = 0; i < size; i++)
+        data[i] = (char)qrand();
+
+    // pattern is planted at the very end, so whole buffer is scanned
+    int sizes[] = {1, 2, 4, 8, 16, 32, 64};
+    for(unsigned s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++) {
+        QByteArray pattern(sizes[s], 0);
+        for(int i = 0; i < pattern.size(); i++)
+            pattern[i] = (char)qrand();
+        memcpy(data.data()+size-pattern.size(), pattern.constData(), pattern.size());
+
+        HexSearch search(pattern);
+        const int runs = 4;
+        int hit = -1;
+        QElapsedTimer timer;
+        timer.start();
+        for(int r = 0; r < runs; r++)
+            hit = search.find((const uint8_t*)data.constData(), size);
+        report(QString("HexSearch/len%1").arg(sizes[s]), runs, (qint64)runs*size,
+               timer.nsecsElapsed(), QString("\"hit\": %1").arg(hit));
+    }
+}
+
+void HexBenchmark::paint() {
+    const int size = 1024*1024;
+    QByteArray data(size, 0);
+    for(int i = 0; i < size; i++)
+        data[i] = (char)qrand();
+
+    HexWidget *widget = new HexWidget(new HexDocument(new HexBuffer(data)));
+    widget->setAttribute(Qt::WA_DontShowOnScreen);
+    widget->show();
+    QList<QPair<QString, HexView *> > views;
+    views << qMakePair(QString("HexOffsetView"), (HexView*)widget->findChild<HexOffsetView*>())
+          << qMakePair(QString("HexDataView"), (HexView*)widget->findChild<HexDataView*>())
+          << qMakePair(QString("HexTextView"), (HexView*)widget->findChild<HexTextView*>());
+
+    QList<QSize> sizes;
+    sizes << QSize(640, 480) << QSize(1280, 1024) << QSize(1920, 1080) << QSize(3840, 2160);
+    foreach(QSize windowSize, sizes) {
+        widget->resize(windowSize);
+        qApp->processEvents();
+
+        for(int v = 0; v < views.size(); v++) {
+            HexView *view = views[v].second;
+            QPixmap pix(view->size());
+            view->render(&pix); // atlas warm up
+
+            const int frames = 20;
+            QElapsedTimer timer;
+            timer.start();
+            for(int i = 0; i < frames; i++)
+                view->render(&pix);
+            report(QString("%1/paint/%2x%3").arg(views[v].first)
+                   .arg(windowSize.width()).arg(windowSize.height()),
+                   frames, 0, timer.nsecsElapsed(),
+                   QString("\"viewWidth\": %1, \"viewHeight\": %2")
+                   .arg(view->width()).arg(view->height()));
+        }
+    }
+
+    // arrow key press repaints rows of old and new cursor only
+    widget->resize(3840, 2160);
+    qApp->processEvents();
+    for(int v = 1; v < views.size(); v++) {
+        HexView *view = views[v].second;
+        QPixmap pix(view->size());
+        int rowHeight = view->parent()->charHeight();
+        const int frames = 200;
+        QElapsedTimer timer;
+        timer.start();
+        for(int i = 0; i < frames; i++) {
+            int row = i%(view->rows()-1);
+            view->render(&pix, QPoint(), QRegion(0, row*rowHeight, view->width(), 2*rowHeight));
+        }
+        report(QString("%1/keystroke").arg(views[v].first), frames, 0, timer.nsecsElapsed());
+    }
+
+    // line by line scrolling, all rows but one should come from row cache
+    widget->resize(1920, 1080);
+    qApp->processEvents();
+    for(int v = 1; v < views.size(); v++) {
+        HexView *view = views[v].second;
+        QPixmap pix(view->size());
+        widget->cursor()->setTop(0);
+        view->render(&pix);
+
+        qint64 hits = view->rowCacheHits();
+        qint64 misses = view->rowCacheMisses();
+        const int frames = 200;
+        QElapsedTimer timer;
+        timer.start();
+        for(int i = 1; i <= frames; i++) {
+            widget->cursor()->setTop((OffType)i*view->cols());
+            view->render(&pix);
+        }
+        qint64 nsecs = timer.nsecsElapsed();
+        hits = view->rowCacheHits()-hits;
+        misses = view->rowCacheMisses()-misses;
+        report(QString("%1/scroll").arg(views[v].first), frames, 0, nsecs,
+               QString("\"rowHits\": %1, \"rowMisses\": %2, \"rowHitRate\": %3")
+               .arg(hits).arg(misses).arg(hits+misses ? (double)hits/(hits+misses) : 0, 0, 'f', 3));
+    }
+
+    // QPainter atlas against direct scanline copy, row cache defeated every frame
+    {
+        QSettings settings;
+        settings.beginGroup("HexWidget");
+        QVariant oldFont = settings.value("mFont");
+        QVariant oldCols = settings.value("mCols");
+        QVariant oldMode = settings.value("mRenderMode");
+        const int fontSizes[] = {8, 12, 20};
+        const int colCounts[] = {16, 32, 64};
+        const char *modeNames[] = {"painter", "scanline"};
+
+        for(int f = 0; f < 3; f++) {
+            for(int c = 0; c < 3; c++) {
+                QFont font(HexSettings::defFont());
+                font.setPointSize(fontSizes[f]);
+                settings.setValue("mFont", font);
+                settings.setValue("mCols", colCounts[c]);
+                widget->resize(1920, 1080);
+
+                for(int mode = HexWidgetPrivate::PainterRender; mode <= HexWidgetPrivate::ScanlineRender; mode++) {
+                    settings.setValue("mRenderMode", mode);
+                    applySettings();
+                    for(int v = 1; v < views.size(); v++) {
+                        HexView *view = views[v].second;
+                        QPixmap pix(view->size());
+                        view->render(&pix); // atlas warm up
+
+                        const int frames = 20;
+                        QElapsedTimer timer;
+                        timer.start();
+                        for(int i = 0; i < frames; i++) {
+                            view->clearRowCache();
+                            view->render(&pix);
+                        }
+                        report(QString("%1/renderer/%2/font%3/cols%4").arg(views[v].first)
+                               .arg(modeNames[mode]).arg(fontSizes[f]).arg(colCounts[c]),
+                               frames, 0, timer.nsecsElapsed(),
+                               QString("\"viewWidth\": %1, \"viewHeight\": %2")
+                               .arg(view->width()).arg(view->height()));
+                    }
+                }
+            }
+        }
+
+        if(oldFont.isValid()) settings.setValue("mFont", oldFont);
+        else settings.remove("mFont");
+        if(oldCols.isValid()) settings.setValue("mCols", oldCols);
+        else settings.remove("mCols");
+        if(oldMode.isValid()) settings.setValue("mRenderMode", oldMode);
+        else settings.remove("mRenderMode");
+        applySettings();
+    }
+
+    // byte class colors come from lookup tables, should cost nothing over parity colors
+    widget->resize(1920, 1080);
+    QSettings settings;
+    QVariant oldClasses = settings.value("HexWidget/mByteClasses");
+    for(int classes = 0; classes < 2; classes++) {
+        settings.setValue("HexWidget/mByteClasses", classes);
+        applySettings();
+        for(int v = 1; v < views.size(); v++) {
+            HexView *view = views[v].second;
+            QPixmap pix(view->size());
+            view->render(&pix); // atlas warm up
+
+            const int frames = 20;
+            QElapsedTimer timer;
+            timer.start();
+            for(int i = 0; i < frames; i++) {
+                view->clearRowCache();
+                view->render(&pix);
+            }
+            report(QString("%1/byteClasses/%2").arg(views[v].first).arg(classes ? "on" : "off"),
+                   frames, 0, timer.nsecsElapsed());
+        }
+    }
+    if(oldClasses.isValid()) settings.setValue("HexWidget/mByteClasses", oldClasses);
+    else settings.remove("HexWidget/mByteClasses");
+    applySettings();
+
+    // burst of edits, repaints should be capped at scheduler's frame rate
+    HexRepaintScheduler *scheduler = HexRepaintScheduler::instance();
+    scheduler->resetStats();
+    HexDocument *doc = widget->document();
+    const int edits = 5000;
+    QElapsedTimer timer;
+    timer.start();
+    for(int i = 0; i < edits; i++) {
+        (*doc)[(OffType)(i*7919)%size] = i;
+        if(!(i%16)) qApp->processEvents();
+    }
+    while(timer.elapsed() < 1000/scheduler->frameRate()+50)
+        qApp->processEvents(); // last frame
+    report("HexRepaintScheduler/editBurst", edits, 0, timer.nsecsElapsed(),
+           QString("\"frames\": %1, \"coalescedRequests\": %2, \"avgFrameNsecs\": %3, "
+                   "\"maxFrameNsecs\": %4")
+           .arg(scheduler->stats().frames).arg(scheduler->stats().coalescedRequests)
+           .arg(scheduler->stats().averageFrameNsecs(), 0, 'f', 0)
+           .arg(scheduler->stats().maxFrameNsecs));
+
+    // windows of the same look share one atlas, only first one rasterizes
+    const int windowCount = 40;
+    QList<HexWidget *> windows;
+    timer.restart();
+    for(int i = 0; i < windowCount; i++) {
+        HexWidget *window = new HexWidget(new HexDocument(new HexBuffer(data.left(64*1024))));
+        window->setAttribute(Qt::WA_DontShowOnScreen);
+        window->resize(1280, 1024);
+        window->show();
+        QPixmap pix(window->size());
+        window->render(&pix);
+        windows << window;
+    }
+    report("HexGlyphCache/open40", windowCount, 0, timer.nsecsElapsed(),
+           QString("\"atlases\": %1").arg(HexGlyphCache::instance()->atlasCount()));
+    qDeleteAll(windows);
+
+    delete widget;
+    QCoreApplication::sendPostedEvents(0, QEvent::DeferredDelete);
+}
+
+
+int main(int argc, char *argv[]) {
+    Q_INIT_RESOURCE(resources);
+
+    QApplication app(argc, argv);
+    app.setOrganizationName("Nikita Sadkov");
+    // keep benchmark settings away from user's ones
+    app.setApplicationName("qhexed-benchmark");
+
+    QByteArray json = HexBenchmark().run();
+
+    QFile out;
+    if(argc > 1) out.setFileName(QString::fromLocal8Bit(argv[1]));
+    if(out.fileName().isEmpty() ? !out.open(stdout, QIODevice::WriteOnly)
+                                : !out.open(QIODevice::WriteOnly)) {
+        fprintf(stderr, "qhexed-benchmark: cannot write benchmark results\n");
+        return 1;
+    }
+    out.write(json);
+    return 0;
+}
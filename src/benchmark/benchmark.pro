@@ -0,0 +1,39 @@
+################################################################
+# qhexed-benchmark - timings of caches, data models and painting
+#
+# Built separately from qhexed, so the release executable carries
+# no benchmark code. Run "qhexed-benchmark [file]" to get results
+# as JSON on stdout or in file.
+################################################################
+
+QT       += core gui
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets concurrent
+TEMPLATE = app
+
+#don't create bundle on OSX
+CONFIG-=app_bundle
+
+ROOT = $${PWD}/../..
+DESTDIR      = $${ROOT}
+
+TARGET       = qhexed-benchmark
+
+# qhexed.cpp leaves main() to benchmark.cpp
+DEFINES += HEX_BENCHMARK
+
+INCLUDEPATH += ..
+
+RESOURCES += ../resources.qrc
+
+
+SOURCES = \
+    ../qhexed.cpp \
+    benchmark.cpp
+
+
+HEADERS = \
+    ../qhexed.h
+
+#remove the annoyances
+QMAKE_CFLAGS_WARN_ON -= -Wall
+QMAKE_CXXFLAGS_WARN_ON -= -Wall
@@ -64,6 +64,9 @@ bool BasicFileAccess::init(HexEd *ed) {
     mEd->addAction(HexFileAction, loadFileAct);
     mEd->addAction(HexFileAction, loadTextFileAct);
 
+    // ask after main window is shown
+    QTimer::singleShot(0, this, SLOT(recoverJournals()));
+
     return true;
 }
 
@@ -82,6 +85,13 @@ void BasicFileAccess::openFile() {
     QString filePath = QFileDialog::getOpenFileName(qApp->activeWindow());
     if(filePath.isEmpty()) return;
 
+    // second window on the same file shares its document and cache
+    if(HexDocument *doc = HexDocument::openedFile(filePath)) {
+        mEd->addWindow(new HexDataWindow(doc));
+        mEd->updateStatus(tr("File already opened, new view created"));
+        return;
+    }
+
     QFile *file = new QFile(filePath);
 
     if(!file->open(QFile::ReadWrite) && !file->open(QFile::ReadOnly)) {
@@ -93,11 +103,11 @@ void BasicFileAccess::openFile() {
         return;
     }
 
+    // document is shared between windows, so it is not owned by any of them
     HexDocument *doc = new HexDocument(new HexFile(file), this);
     doc->setName(QFileInfo(filePath).fileName());
-    HexWindow *win = new HexDataWindow(doc);
-    doc->setParent(win);
-    mEd->addWindow(win);
+    doc->registerFile(filePath);
+    mEd->addWindow(new HexDataWindow(doc));
     mEd->updateStatus(tr("File opened"));
 }
 
@@ -124,6 +134,33 @@ void BasicFileAccess::loadFile() {
     mEd->updateStatus(tr("File loaded"));
 }
 
+void BasicFileAccess::recoverJournals() {
+    foreach(QString fileName, HexJournal::staleJournals()) {
+        int ret = QMessageBox::question(qApp->activeWindow(), tr("Recover Unsaved Changes?"),
+                                        tr("Previous session was not closed properly.\n"
+                                           "Recover unsaved changes of %1?")
+                                        .arg(HexJournal::describe(fileName)),
+                                        QMessageBox::Yes, QMessageBox::No, QMessageBox::Cancel);
+        if(ret == QMessageBox::Cancel) continue; // ask again next time
+
+        if(ret == QMessageBox::Yes) {
+            QApplication::setOverrideCursor(Qt::WaitCursor);
+            HexDocument *doc = HexJournal::recover(fileName);
+            QApplication::restoreOverrideCursor();
+            if(!doc) {
+                QMessageBox::warning(qApp->activeWindow(), tr("Recovery failed!"),
+                                     tr("Cannot recover changes from %1.").arg(fileName));
+                continue;
+            }
+            HexWindow *win = new HexDataWindow(doc);
+            doc->setParent(win);
+            mEd->addWindow(win);
+            mEd->updateStatus(tr("Changes recovered"));
+        }
+        QFile::remove(fileName);
+    }
+}
+
 void BasicFileAccess::loadTextFile() {
     QString filePath = QFileDialog::getOpenFileName(qApp->activeWindow());
     if(filePath.isEmpty()) return;
@@ -156,7 +193,8 @@ void InspectorModel::setCursor(HexCursor *cur) {
 
     mCursor = cur;
     if(cursor()) {
-        connect(document(), SIGNAL(changed()), this, SLOT(updateModel()));
+        connect(document(), SIGNAL(rangeChanged(OffType, OffType, OffType)),
+            this, SLOT(documentChanged(OffType, OffType, OffType)));
         connect(cursor(), SIGNAL(changed()), this, SLOT(updateModel()));
         connect(document(), SIGNAL(destroyed(QObject * )),
             this, SLOT(documentDestroyed(QObject * )));
@@ -164,6 +202,13 @@ void InspectorModel::setCursor(HexCursor *cur) {
     updateModel();
 }
 
+// inspectors look at most 16 bytes past cursor
+void InspectorModel::documentChanged(OffType start, OffType end, OffType delta) {
+    OffType pos = cursor()->position();
+    if(start < pos+16 && (delta || end > pos))
+        HexRepaintScheduler::instance()->call(this, "updateModel");
+}
+
 void InspectorModel::documentDestroyed(QObject *obj) {
     mCursor = 0; // no need to disconnect anything
     setCursor(0);
@@ -659,18 +704,19 @@ void HexBuffer::read(void *dstVoid, OffType src64, OffType size64) {
         end = mSize;
     }
 
-    QMutableLinkedListIterator<QByteArray> it(mBuffer);
+    // const access, chunks may be shared with undo stack
+    QLinkedListIterator<QByteArray> it(mBuffer);
 
     OffType offset = 0;
 
     for(;;) {
         assert(it.hasNext());
-        QByteArray &ba = it.next();
+        const QByteArray &ba = it.next();
         OffType nextOffset = offset+ba.size();
         if(start < nextOffset) {
             int add = start - offset;
             int rdsz = qMin(ba.size()-add, (int)(end-start));
-            memcpy(dst, ba.data()+add, rdsz);
+            memcpy(dst, ba.constData()+add, rdsz);
             dst += rdsz;
             start += rdsz;
             break;
@@ -680,9 +726,9 @@ void HexBuffer::read(void *dstVoid, OffType src64, OffType size64) {
 
     while(start < end) {
         assert(it.hasNext());
-        QByteArray &ba = it.next();
+        const QByteArray &ba = it.next();
         int rdsz = qMin(ba.size(), (int)(end-start));
-        memcpy(dst, ba.data(), rdsz);
+        memcpy(dst, ba.constData(), rdsz);
         dst += rdsz;
         start += rdsz;
     }
@@ -703,16 +749,16 @@ void HexBuffer::del(OffType start, OffType end) {
         OffType nextOffset = offset + ba.size();
         if(start < nextOffset) {
             if(offset < start) {
-                QByteArray left(ba.data(), start-offset);
+                QByteArray left(ba.constData(), start-offset);
                 if(nextOffset <= end) ba = left;
                 else {
-                    QByteArray right(ba.data() + end-offset, nextOffset-end);
+                    QByteArray right(ba.constData() + end-offset, nextOffset-end);
                     ba = left;
                     it.insert(right);
                 }
             } else {
                 if(end < nextOffset)
-                    ba = QByteArray(ba.data() + end-offset, nextOffset-end);
+                    ba = QByteArray(ba.constData() + end-offset, nextOffset-end);
                 else {
                     it.remove();
                 }
@@ -728,7 +774,7 @@ void HexBuffer::del(OffType start, OffType end) {
         QByteArray &ba = it.next();
         OffType nextOffset = offset + ba.size();
         if(end < nextOffset)
-            ba = QByteArray(ba.data() + end-offset, nextOffset-end);
+            ba = QByteArray(ba.constData() + end-offset, nextOffset-end);
         else {
             it.remove();
         }
@@ -737,43 +783,75 @@ void HexBuffer::del(OffType start, OffType end) {
 }
 
 void HexBuffer::paste(OffType where, const QByteArray &what) {
-    if(!what.size()) return;
+    pastePieces(where, QList<QByteArray>() << what);
+}
 
-    if(!where) {
-        mBuffer.prepend(what);
-        mSize += what.size();
-        return;
-    }
+void HexBuffer::pastePieces(OffType where, const QList<QByteArray> &pieces) {
+    OffType size = 0;
+    foreach(const QByteArray &piece, pieces)
+        size += piece.size();
+    if(!size) return;
 
-    if(where >= mSize) {
-        mBuffer.append(what);
-        mSize += what.size();
-        return;
+    QMutableLinkedListIterator<QByteArray> it(mBuffer);
+
+    if(where >= mSize) it.toBack();
+    else if(where) {
+        OffType offset = 0;
+        for(;;) {
+            assert(it.hasNext());
+            QByteArray &ba = it.next();
+            OffType nextOffset = offset + ba.size();
+            if(where < nextOffset) {
+                if(where == offset) {
+                    it.previous();
+                } else {
+                    int splitPoint = where - offset;
+                    QByteArray right(ba.constData() + splitPoint, ba.size()-splitPoint);
+                    ba = QByteArray(ba.constData(), splitPoint);
+                    it.insert(right);
+                    it.previous();
+                }
+                break;
+            }
+            offset = nextOffset;
+        }
     }
 
-    QMutableLinkedListIterator<QByteArray> it(mBuffer);
+    // pieces are inserted as is, without copying
+    foreach(const QByteArray &piece, pieces)
+        if(piece.size()) it.insert(piece);
+    mSize += size;
+}
+
+QList<QByteArray> HexBuffer::pieces(OffType start, OffType end, int maxCopy, qint64 &copied) {
+    QList<QByteArray> ret;
+    if(end > mSize) end = mSize;
+
+    QLinkedListIterator<QByteArray> it(mBuffer);
 
     OffType offset = 0;
-    for(;;) {
-        assert(it.hasNext());
-        QByteArray &ba = it.next();
+    while(offset < end && it.hasNext()) {
+        const QByteArray &ba = it.next();
         OffType nextOffset = offset + ba.size();
-        if(where < nextOffset) {
-            if(where == offset) {
-                it.previous();
-                it.insert(what);
-            } else {
-                int splitPoint = where - offset;
-                QByteArray right(ba.data() + splitPoint, ba.size()-splitPoint);
-                ba = QByteArray(ba.data(), splitPoint);
-                it.insert(what);
-                it.insert(right);
+        if(start < nextOffset) {
+            if(start <= offset && nextOffset <= end) ret.append(ba);
+            else {
+                // part of chunk crossing range end, caller may spill it
+                // before asking for the rest
+                OffType from = qMax(start, offset);
+                OffType to = qMin(qMin(end, nextOffset), from+maxCopy);
+                ret.append(QByteArray(ba.constData() + from-offset, to-from));
+                copied += to-from;
+                break;
             }
-            break;
         }
         offset = nextOffset;
     }
-    mSize += what.size();
+    return ret;
+}
+
+bool HexBuffer::hasSharedPieces() {
+    return true;
 }
 
 OffType HexBuffer::getLength() {
@@ -831,38 +909,110 @@ OffType HexBuffer::getPageSize() {
 
 #define map (*(Hash*)hashMap)
 
-HexCache::HexCache(HexDataModel &inDsm, int cacheSize, int inPageSize)
+QList<HexCache*> HexCache::mInstances;
+OffType HexCache::mGlobalBudget = 0;
+
+HexCache::HexCache(HexDataModel &inDsm, OffType cacheSize, int inPageSize)
     : dsm(inDsm) {
-    pageSize = inPageSize > 0 ? inPageSize : dsm.getPageSize();
-    if(pageSize < 1) pageSize = 1;
-    numPages = (cacheSize+pageSize-1)/pageSize;
-    if(numPages < 3) numPages = 3;
+    mPageSize = inPageSize > 0 ? inPageSize : dsm.getPageSize();
+    if(mPageSize < 1) mPageSize = 1;
+    mNumPages = 0;
+    mRequestedSize = cacheSize;
+    leastRecentlyUsed = 0;
+    mostRecentlyUsed = 0;
+
+    hashMap = new Hash;
+
+    mInstances.append(this);
+    rebalance();
+}
 
-    pages = new Page[numPages];
-    for(int i = 0; i < numPages; i++) {
-        pages[i].data = new uint8_t[pageSize];
-        pages[i].modified = -1;
-        pages[i].offset = (OffType)-1;
+HexCache::~HexCache() {
+    mInstances.removeAll(this);
+
+    flush();
+    Page *page = leastRecentlyUsed;
+    while(page) {
+        Page *next = page->next;
+        delete [] page->data;
+        delete page;
+        page = next;
+    }
+
+    delete &map;
+
+    rebalance();
+}
 
-        if(i) pages[i].prev = &pages[i-1];
-        else pages[i].prev = 0;
+void HexCache::resize(int newNumPages) {
+    if(newNumPages < 3) newNumPages = 3;
 
-        if(i+1 < numPages) pages[i].next = &pages[i+1];
-        else pages[i].next = 0;
+    // new pages are empty, so they go to least recently used end
+    while(mNumPages < newNumPages) {
+        Page *page = new Page;
+        page->data = new uint8_t[mPageSize];
+        page->numDirty = 0;
+        page->offset = (OffType)-1;
+        page->prev = 0;
+        page->next = leastRecentlyUsed;
+        if(leastRecentlyUsed) leastRecentlyUsed->prev = page;
+        else mostRecentlyUsed = page;
+        leastRecentlyUsed = page;
+        mNumPages++;
     }
-    leastRecentlyUsed = &pages[0];
-    mostRecentlyUsed = &pages[numPages-1];
 
-    hashMap = new Hash;
+    // and we drop least recently used pages first
+    while(mNumPages > newNumPages) {
+        Page *page = leastRecentlyUsed;
+        flushPage(page);
+        if(page->offset != (OffType)-1)
+            map.remove(page->offset);
+        leastRecentlyUsed = page->next;
+        leastRecentlyUsed->prev = 0;
+        delete [] page->data;
+        delete page;
+        mNumPages--;
+    }
 }
 
-HexCache::~HexCache() {
+void HexCache::rebalance() {
+    OffType total = 0;
+    foreach(HexCache *cache, mInstances)
+        total += cache->mRequestedSize;
+
+    foreach(HexCache *cache, mInstances) {
+        OffType size = cache->mRequestedSize;
+        if(mGlobalBudget > 0 && total > mGlobalBudget)
+            size = (OffType)((double)size*mGlobalBudget/total);
+        cache->resize((int)qMin((size+cache->mPageSize-1)/cache->mPageSize, (OffType)0x7fffffff));
+    }
+}
+
+void HexCache::setCacheSize(OffType cacheSize) {
+    if(cacheSize == mRequestedSize) return;
+    mRequestedSize = cacheSize;
+    rebalance();
+}
+
+void HexCache::setPageSize(int inPageSize) {
+    int newPageSize = inPageSize > 0 ? inPageSize : dsm.getPageSize();
+    if(newPageSize < 1) newPageSize = 1;
+    if(newPageSize == mPageSize) return;
+
     flush();
-    for(int i = 0; i < numPages; i++)
-        delete pages[i].data;
-    delete [] pages;
+    clear();
+    for(Page *page = leastRecentlyUsed; page; page = page->next) {
+        delete [] page->data;
+        page->data = new uint8_t[newPageSize];
+    }
+    mPageSize = newPageSize;
+    rebalance();
+}
 
-    delete &map;
+void HexCache::setGlobalBudget(OffType budget) {
+    if(budget == mGlobalBudget) return;
+    mGlobalBudget = budget;
+    rebalance();
 }
 
 HexCache::Page *HexCache::fetchDeep(OffType pageOffset) {
@@ -878,6 +1028,7 @@ HexCache::Page *HexCache::fetchDeep(OffType pageOffset) {
     else page = 0;
 
     if(page) {
+        if(page == mostRecentlyUsed) return page;
         if(page->prev) // if not leastRecentlyUsed
             page->prev->next = page->next;
         else
@@ -897,8 +1048,9 @@ HexCache::Page *HexCache::fetchDeep(OffType pageOffset) {
         page->offset = pageOffset;
         map[page->offset] = page;
 
-        //fprintf(stderr, "HexCache::fetchDeep(): 0x%08X\n", page->offset*pageSize);
-        dsm.read(page->data, page->offset*pageSize, pageSize);
+        //fprintf(stderr, "HexCache::fetchDeep(): 0x%08X\n", page->offset*mPageSize);
+        dsm.read(page->data, page->offset*mPageSize, mPageSize);
+        mStats.misses++;
 
     }
     page->next->prev = page->prev;
@@ -911,15 +1063,156 @@ HexCache::Page *HexCache::fetchDeep(OffType pageOffset) {
 
 void HexCache::clear() {
     map.clear();
-    for(int i = 0; i < numPages; i++) {
-        pages[i].offset = (OffType)-1;
-        pages[i].modified = -1;
+    for(Page *page = leastRecentlyUsed; page; page = page->next) {
+        page->offset = (OffType)-1;
+        page->numDirty = 0;
+    }
+}
+
+static bool pageOffsetLessThan(const HexCache::Page *a, const HexCache::Page *b) {
+    return a->offset < b->offset;
+}
+
+void HexCache::discardPage(Page *page) {
+    map.remove(page->offset);
+    page->offset = (OffType)-1;
+    page->numDirty = 0;
+    if(page == leastRecentlyUsed) return;
+
+    // unused pages are the first ones to be reused
+    page->prev->next = page->next;
+    if(page->next) page->next->prev = page->prev;
+    else mostRecentlyUsed = page->prev;
+    page->prev = 0;
+    page->next = leastRecentlyUsed;
+    leastRecentlyUsed->prev = page;
+    leastRecentlyUsed = page;
+}
+
+void HexCache::remap(OffType where, OffType delta) {
+    if(!delta) return;
+
+    // first byte in new coordinates which isn't affected by the edit
+    OffType editEnd = where + qMax(delta, (OffType)0);
+
+    QVector<Page*> moved;
+    for(Page *page = leastRecentlyUsed; page; page = page->next)
+        if(page->offset != (OffType)-1 && (page->offset+1)*mPageSize > where)
+            moved.append(page);
+    if(moved.isEmpty()) return;
+    qSort(moved.begin(), moved.end(), pageOffsetLessThan);
+
+    // old page p is rebuilt into new page k, which starts `skip` bytes into p
+    // and takes the rest from old page p+1; decide everything before touching data
+    QVector<OffType> newOffsets(moved.size());
+    QVector<int> skips(moved.size());
+    QVector<Page*> nexts(moved.size());
+    for(int i = 0; i < moved.size(); i++) {
+        OffType first = moved[i]->offset*mPageSize + delta;
+        newOffsets[i] = (OffType)-1;
+        if(first < 0) continue;
+
+        OffType k = (first+mPageSize-1)/mPageSize;
+        int skip = (int)(k*mPageSize - first);
+        Page *next = 0;
+        if(skip) {
+            Hash::iterator it = map.find(moved[i]->offset+1);
+#ifdef USE_QHASH
+            if(it != map.end()) next = *it;
+#else
+            if(it != map.end()) next = (*it).second;
+#endif
+            if(!next) continue;
+        }
+        if(k*mPageSize < editEnd) continue;
+
+        newOffsets[i] = k;
+        skips[i] = skip;
+        nexts[i] = next;
+    }
+
+    foreach(Page *page, moved)
+        map.remove(page->offset);
+
+    // ascending order guarantees page p+1 still holds old data when p reads it
+    for(int i = 0; i < moved.size(); i++) {
+        Page *page = moved[i];
+        if(newOffsets[i] == (OffType)-1) {
+            page->offset = (OffType)-1; // already unhashed, its key may be reused now
+            discardPage(page);
+            continue;
+        }
+
+        int skip = skips[i];
+        if(skip) {
+            memmove(page->data, page->data+skip, mPageSize-skip);
+            memcpy(page->data+mPageSize-skip, nexts[i]->data, skip);
+        }
+        page->offset = newOffsets[i];
+        map[page->offset] = page;
+    }
+}
+
+void HexCache::update(OffType offset, const void *src, OffType size) {
+    OffType end = offset+size;
+    for(Page *page = leastRecentlyUsed; page; page = page->next) {
+        if(page->offset == (OffType)-1) continue;
+
+        OffType pageStart = page->offset*mPageSize;
+        OffType start = qMax(offset, pageStart);
+        OffType stop = qMin(end, pageStart+mPageSize);
+        if(start < stop)
+            memcpy(page->data + (start-pageStart), (const uint8_t*)src + (start-offset), stop-start);
+    }
+}
+
+void HexCache::markDirty(Page *page, int start, int end) {
+    Interval *dirty = page->dirty;
+    int n = page->numDirty;
+    int i, j;
+
+    // skip intervals strictly before new one and absorb ones touching it
+    for(i = 0; i < n && dirty[i].end < start; i++);
+    for(j = i; j < n && dirty[j].start <= end; j++);
+
+    qint64 added = end-start;
+    if(i < j) {
+        for(int k = i; k < j; k++) {
+            int s = qMax(start, dirty[k].start), e = qMin(end, dirty[k].end);
+            if(s < e) added -= e-s;
+        }
+        start = qMin(start, dirty[i].start);
+        end = qMax(end, dirty[j-1].end);
+    }
+    mStats.bytesDirtied += added;
+
+    if(i == j) { // make room for new interval
+        memmove(dirty+i+1, dirty+i, (n-i)*sizeof(Interval));
+        n++;
+    } else if(j-i > 1) {
+        memmove(dirty+i+1, dirty+j, (n-j)*sizeof(Interval));
+        n -= j-i-1;
     }
+    dirty[i].start = start;
+    dirty[i].end = end;
+
+    // too many intervals: glue the pair with the smallest gap,
+    // gap bytes get written back though nobody modified them
+    if(n > MaxDirty) {
+        int best = 0;
+        for(int k = 1; k+1 < n; k++)
+            if(dirty[k+1].start-dirty[k].end < dirty[best+1].start-dirty[best].end)
+                best = k;
+        dirty[best].end = dirty[best+1].end;
+        memmove(dirty+best+1, dirty+best+2, (n-best-2)*sizeof(Interval));
+        n--;
+    }
+    page->numDirty = n;
 }
 
 void HexCache::flush() {
-    for(int i = 0; i < numPages; i++)
-        flushPage(&pages[i]);
+    for(Page *page = leastRecentlyUsed; page; page = page->next)
+        flushPage(page);
 }
 
 bool HexCache::selfTest() {
@@ -957,12 +1250,27 @@ bool HexCache::selfTest() {
     return success;
 }
 
+int HexCache::read(OffType offset, uint8_t *dst, int size) {
+    OffType length = getLength();
+    if(offset >= length || size <= 0) return 0;
+    size = (int)qMin((OffType)size, length-offset);
+
+    for(int done = 0; done < size; ) {
+        Page *page = fetch(offset+done);
+        int inPage = (int)((offset+done)%mPageSize);
+        int count = qMin(size-done, mPageSize-inPage);
+        memcpy(dst+done, page->data+inPage, count);
+        done += count;
+    }
+    return size;
+}
+
 OffType HexCache::getLength() {
     OffType length = dsm.getLength();
     if(dsm.isGrowable()) {
-        for(int i = 0; i < numPages; i++) {
-            if(pages[i].modified < 0) continue;
-            OffType o = pages[i].offset*pageSize + pages[i].modified+1;
+        for(Page *page = leastRecentlyUsed; page; page = page->next) {
+            if(!page->numDirty) continue;
+            OffType o = page->offset*mPageSize + page->dirty[page->numDirty-1].end;
             if(o > length) length = o;
         }
     }
@@ -972,13 +1280,39 @@ OffType HexCache::getLength() {
 #undef map
 
 
-static QByteArray getMimeData() {
+static HexUndoData getMimeData() {
+    HexUndoData ret;
     const QMimeData *mimeData = qApp->clipboard()->mimeData();
+    const HexMimeData *hexData = qobject_cast<const HexMimeData*>(mimeData);
+
+    if(hexData && hexData->hasFormat("application/octet-stream"))
+        return hexData->pieces();
+
     if(mimeData->hasFormat("application/octet-stream"))
-        return mimeData->data("application/octet-stream");
+        ret.append(mimeData->data("application/octet-stream"));
     else if(mimeData->hasFormat("text/plain"))
-        return mimeData->data("text/plain");
-    return QByteArray();
+        ret.append(mimeData->data("text/plain"));
+    return ret;
+}
+
+// decodes clipboard text as hex, warns about bad input
+static bool getMimeHex(HexUndoData &ret) {
+    const QMimeData *mimeData = qApp->clipboard()->mimeData();
+    QByteArray text = mimeData->data(mimeData->hasFormat("text/plain") ?
+                                     "text/plain" : "application/octet-stream");
+
+    QByteArray data;
+    qint64 bad = HexTextEncoder::decodeHex(text.constData(), text.size(), data);
+    if(bad >= 0) {
+        QMessageBox::warning(qApp->activeWindow(), QObject::tr("Paste Hex failed!"),
+                             QObject::tr("Clipboard doesn't contain valid hex text:\n"
+                                         "bad character at offset %1.").arg(bad));
+        return false;
+    }
+
+    ret.clear();
+    ret.append(data);
+    return !ret.isEmpty();
 }
 
 HexCursor::HexCursor(HexDocument *doc,  QObject *parent)
@@ -1008,7 +1342,7 @@ HexCursor::~HexCursor() {
 }
 
 QByteArray HexCursor::selectedData() {
-    return document()->copy(selectionStart(), selectionEnd());
+    return document()->read(selectionStart(), selectionEnd());
 }
 
 void HexCursor::setDocument(HexDocument *doc) {
@@ -1020,7 +1354,8 @@ void HexCursor::setDocument(HexDocument *doc) {
         document()->release();
     }
     mDocument = doc;
-    connect(document(), SIGNAL(changed()), this, SLOT(documentChanged()));
+    connect(document(), SIGNAL(rangeChanged(OffType, OffType, OffType)),
+            this, SLOT(documentChanged(OffType, OffType, OffType)));
     mAnchor = 0;
     mPosition = 0;
     emit changed();
@@ -1111,9 +1446,9 @@ void HexCursor::setPosition(OffType newPosition, bool moveAnchor) {
     setCursor(newAnchor, newPosition);
 }
 
-void HexCursor::documentChanged() {
+void HexCursor::documentChanged(OffType start, OffType end, OffType delta) {
     // make sure we wont get outside of document
-    setCursor(anchor(), position());
+    if(delta < 0) setCursor(anchor(), position());
 }
 
 void HexCursor::del() {
@@ -1140,6 +1475,18 @@ void HexCursor::pasteOver() {
     document()->pushCommand(new HexPasteOver(position(), getMimeData()));
 }
 
+void HexCursor::pasteHex() {
+    HexUndoData data;
+    if(getMimeHex(data))
+        document()->pushCommand(new HexPaste(position(), data));
+}
+
+void HexCursor::pasteHexOver() {
+    HexUndoData data;
+    if(getMimeHex(data))
+        document()->pushCommand(new HexPasteOver(position(), data));
+}
+
 void HexCursor::redo() {
     document()->redo();
 }
@@ -1189,159 +1536,1112 @@ HexCursor * HexDataWindow::dataCursor() {
 }
 
 
-HexDocument::HexDocument(QObject *parent)
-    : QObject(parent)
-{
-    mBuffer = true;
-    initFrom(new HexBuffer(this));
-
-    static int sequenceNumber = 1;
-    setName(tr("buffer%1").arg(sequenceNumber++));
+HexUndoExtent::~HexUndoExtent() {
+    mStore->release(this);
 }
 
-HexDocument::HexDocument(HexDataModel *model, QObject *parent)
-    : QObject(parent)
-{
-
-    mBuffer = false;
+QByteArray HexUndoExtent::read() const {
+    QByteArray ret(mSize, 0);
+    if(!mStore->read(ret.data(), mOffset, mSize))
+        qWarning() << "failed to read undo store";
+    return ret;
+}
 
-    if(!model->parent())
-        model->setParent(this);
 
-    initFrom(model);
+HexUndoStore::HexUndoStore() {
+    mFile = 0;
+    mSize = 0;
+    mLiveSize = 0;
+    mDestroyed = false;
 }
 
-HexDocument::~HexDocument() {
-    delete mCache;
+HexUndoStore::~HexUndoStore() {
+    delete mFile;
 }
 
-void HexDocument::initFrom(HexDataModel *model) {
-    mModified = false;
-    mModel = model;
-    mReadOnly = !mModel->isWriteable();
-    mCache = new HexCache(*mModel);
-    mCursor = new HexCursor(this);
-    mUndoStack = new QUndoStack(this);
-    mRefs = 0; // this is last cuz our mCursor also references us
+void HexUndoStore::destroy() {
+    mDestroyed = true;
+    if(mExtents.isEmpty()) delete this;
 }
 
-bool HexDocument::maybeSave() {
-    if(mBuffer && mModified) {
-        int ret;
-        ret = QMessageBox::warning(qApp->activeWindow(), tr("Save Changes?"),
-                                   tr("'%1' has been modified.\n"
-                                      "Do you want to save your changes?")
-                                   .arg(userFriendlyName()),
-                                   QMessageBox::Yes, QMessageBox::No, QMessageBox::Cancel);
-        if (ret == QMessageBox::Yes)
-            return save();
-        else if (ret == QMessageBox::Cancel)
-            return false;
-    } else {
-        mCache->flush();
+HexUndoExtent *HexUndoStore::write(const char *data, qint64 size) {
+    if(!mFile) {
+        mFile = new QTemporaryFile;
+        if(!mFile->open()) {
+            qWarning() << "failed to create undo store: " << mFile->errorString();
+            delete mFile;
+            mFile = 0;
+            return 0;
+        }
     }
-    return true;
-}
 
-bool HexDocument::save() {
-    bool ret;
-    if(mPath.isEmpty()) {
-        if(mBuffer)
-            ret = saveAs();
-        else {
-            mCache->flush();
-            ret = true;
-            setModified(false);
-        }
+    // first hole big enough, end of file otherwise
+    QMap<qint64, qint64>::iterator hole = mFree.begin();
+    while(hole != mFree.end() && hole.value() < size)
+        ++hole;
+    qint64 offset = hole != mFree.end() ? hole.key() : mSize;
+
+    // failed write leaves holes and mSize as is, so garbage gets overwritten
+    if(!mFile->seek(offset) || mFile->write(data, size) != size)
+        return 0;
+
+    if(hole != mFree.end()) {
+        qint64 left = hole.value()-size;
+        mFree.erase(hole);
+        if(left) mFree.insert(offset+size, left);
     } else {
-        ret = saveFile(mPath);
+        mSize += size;
     }
-    return ret;
+    mLiveSize += size;
+
+    HexUndoExtent *extent = new HexUndoExtent(this, offset, size);
+    mExtents.insert(extent);
+    return extent;
 }
 
-bool HexDocument::saveAs() {
-    QString fileName = QFileDialog::getSaveFileName(qApp->activeWindow(), tr("Save As"), mName);
-    if(fileName.isEmpty())
+bool HexUndoStore::read(char *dst, qint64 offset, qint64 size) {
+    if(!mFile || offset+size > mSize || !mFile->seek(offset))
         return false;
-
-    return saveFile(fileName);
+    return mFile->read(dst, size) == size;
 }
 
-bool HexDocument::saveFile(const QString &fileName) {
-    QFile file(fileName);
-    if (!file.open(QFile::WriteOnly)) {
-        QMessageBox::warning(qApp->activeWindow(), tr("Save failed!"),
-                             tr("Cannot write file %1:\n%2.")
-                             .arg(fileName)
-                             .arg(file.errorString()));
-        return false;
+void HexUndoStore::release(HexUndoExtent *extent) {
+    mExtents.remove(extent);
+    mLiveSize -= extent->mSize;
+    if(mDestroyed && mExtents.isEmpty()) {
+        delete this;
+        return;
     }
 
-    int length = mCache->getLength();
+    qint64 offset = extent->mOffset;
+    qint64 size = extent->mSize;
+    QMap<qint64, qint64>::iterator next = mFree.lowerBound(offset);
+    if(next != mFree.end() && next.key() == offset+size) {
+        size += next.value();
+        next = mFree.erase(next);
+    }
+    if(next != mFree.begin()) {
+        QMap<qint64, qint64>::iterator prev = next;
+        --prev;
+        if(prev.key()+prev.value() == offset) {
+            offset = prev.key();
+            size += prev.value();
+            mFree.erase(prev);
+        }
+    }
 
-    QApplication::setOverrideCursor(Qt::WaitCursor);
-    for(int i = 0; i < length; i++)
-        file.putChar((*mCache)[i]);
-    QApplication::restoreOverrideCursor();
+    if(offset+size < mSize) {
+        mFree.insert(offset, size);
+    } else {
+        // hole at the end just shortens the file
+        mSize = offset;
+        mFile->resize(mSize);
+    }
 
-    setPath(fileName);
-    setModified(false);
+    qint64 dead = mSize-mLiveSize;
+    if(dead > mLiveSize && dead >= MinCompactSize)
+        compact();
+}
+
+// extents keep their order and only move towards the start of file, so
+// moving one never overwrites another that wasn't moved yet
+void HexUndoStore::compact() {
+    QMap<qint64, HexUndoExtent*> extents;
+    foreach(HexUndoExtent *extent, mExtents)
+        extents.insert(extent->mOffset, extent);
+
+    QByteArray buffer;
+    qint64 end = 0;
+    foreach(HexUndoExtent *extent, extents) {
+        if(extent->mOffset != end) {
+            buffer.resize(extent->mSize);
+            if(!read(buffer.data(), extent->mOffset, extent->mSize) ||
+               !mFile->seek(end) || mFile->write(buffer.constData(), extent->mSize) != extent->mSize) {
+                qWarning() << "failed to compact undo store: " << mFile->errorString();
+                break;
+            }
+            extent->mOffset = end;
+        }
+        end += extent->mSize;
+    }
 
-    return true;
+    // rebuild holes, a failed move leaves some
+    mFree.clear();
+    end = 0;
+    foreach(HexUndoExtent *extent, extents) {
+        if(extent->mOffset > end) mFree.insert(end, extent->mOffset-end);
+        end = extent->mOffset+extent->mSize;
+    }
+    mSize = end;
+    mFile->resize(mSize);
 }
 
-void HexDocument::setModified(bool state) {
-    if(!state && mModified) {
-        mModified = false;
-        emit saved();
-    } else {
-        mModified = state;
-        if(mModified)
-            emit changed();
+
+void HexUndoData::clear() {
+    mExtents.clear();
+    mPieces.clear();
+    mSize = 0;
+    mStoredSize = 0;
+}
+
+void HexUndoData::append(const QByteArray &piece) {
+    if(piece.isEmpty()) return;
+    mPieces.append(piece);
+    mSize += piece.size();
+}
+
+// extents of different stores may follow each other, so spilled part
+// grows without reading back what is already on disk
+void HexUndoData::spill(HexUndoStore *store) {
+    while(!mPieces.isEmpty()) {
+        QByteArray &piece = mPieces.first();
+        int done = 0;
+        while(done < piece.size()) {
+            int size = qMin(piece.size()-done, (int)ChunkSize);
+            HexUndoExtent *extent = store->write(piece.constData()+done, size);
+            if(!extent) break;
+            mExtents.append(QExplicitlySharedDataPointer<HexUndoExtent>(extent));
+            mStoredSize += size;
+            done += size;
+        }
+        if(done < piece.size()) {
+            // disk is full, keep the rest in memory
+            if(done) piece = piece.mid(done);
+            return;
+        }
+        mPieces.removeFirst();
     }
 }
 
-QString HexDocument::name() {
-    return mName;
+int HexUndoData::chunkCount() const {
+    return mExtents.size() + mPieces.size();
 }
 
-void HexDocument::setName(QString name) {
-    if(mName != name) {
-        mName = name;
-        emit nameChanged();
-    }
+QByteArray HexUndoData::chunk(int index) const {
+    if(index < mExtents.size())
+        return mExtents.at(index)->read();
+    return mPieces.at(index-mExtents.size());
 }
 
-QString HexDocument::path() {
-    return mPath;
+QList<QByteArray> HexUndoData::pieces() const {
+    QList<QByteArray> ret;
+    int count = chunkCount();
+    for(int i = 0; i < count; i++)
+        ret.append(chunk(i));
+    return ret;
 }
 
-void HexDocument::setPath(QString path) {
-    if(mPath != path) {
-        mPath = path;
-        mName = QFileInfo(mPath).fileName();
-        emit nameChanged();
-    }
+QByteArray HexUndoData::toByteArray() const {
+    if(!isSpilled() && mPieces.size() == 1)
+        return mPieces.first();
+
+    QByteArray ret;
+    ret.reserve(mSize);
+    int count = chunkCount();
+    for(int i = 0; i < count; i++)
+        ret.append(chunk(i));
+    return ret;
 }
 
-QString HexDocument::userFriendlyName() {
-    return mName;
 
-}
+QLinkedList<HexUndoCommand*> HexUndoCommand::mInstances;
+qint64 HexUndoCommand::mTotalUsage = 0;
 
-void HexDocument::putByte(OffType offset, uint8_t byte) {
-    if(mReadOnly) {
-        QMessageBox::warning(qApp->activeWindow(), tr("Editing is disabled!"),
-            tr("Document you are trying to edit is readonly."));
-        return;
+void HexUndoCommand::limitMemory(qint64 limit) {
+    if(limit <= 0 || mTotalUsage <= limit) return;
+
+    // oldest commands are least likely to be undone
+    QLinkedList<HexUndoCommand*>::iterator it = mInstances.begin();
+    for(; it != mInstances.end() && mTotalUsage > limit; ++it) {
+        HexUndoCommand *cmd = *it;
+        if(!cmd->memoryUsage()) continue;
+        cmd->spill(cmd->document()->undoStore());
+        cmd->account();
     }
-    pushCommand(new HexReplaceByte(offset, byte));
 }
 
-void HexDocument::pushCommand(HexUndoCommand *cmd) {
-    cmd->setDocument(this);
-    mUndoStack->push(cmd);
-}
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <sys/file.h>
+#endif
+
+// runs in worker thread, GUI thread doesn't touch file till it's done
+static bool writeJournal(QFile *file, QByteArray data, bool sync) {
+    bool ok = file->write(data) == data.size() && file->flush();
+    if(!sync) return ok;
+#ifdef Q_OS_WIN
+    _commit(file->handle());
+#elif defined(Q_OS_LINUX)
+    fdatasync(file->handle()); // size is still synced, mtime isn't needed
+#else
+    fsync(file->handle());
+#endif
+    return ok;
+}
+
+#if QT_VERSION < 0x050000
+// exclusive lock released by OS when owner dies, however it dies
+static bool lockFile(QFile &file) {
+#ifdef Q_OS_WIN
+    // lock byte far past the end, so journal stays readable for others
+    OVERLAPPED overlapped;
+    memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.OffsetHigh = 0xffffffff;
+    return LockFileEx((HANDLE)_get_osfhandle(file.handle()),
+                      LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY, 0, 1, 0, &overlapped);
+#else
+    return flock(file.handle(), LOCK_EX | LOCK_NB) == 0;
+#endif
+}
+#endif
+
+HexJournal::HexJournal(HexDocument *doc)
+    : QObject(doc)
+{
+    mWritePending = false;
+    mFailed = false;
+    QDir().mkpath(directory());
+
+    // uuid keeps names unique across instances and pid reuse,
+    // existing journals are never reopened
+    do {
+        QString uuid = QUuid::createUuid().toString().mid(1, 36);
+        mFile.setFileName(QDir(directory()).filePath(QString("%1-%2.journal")
+                          .arg(QCoreApplication::applicationPid()).arg(uuid)));
+    } while(mFile.exists());
+
+#if QT_VERSION >= 0x050000
+    mLock = new QLockFile(mFile.fileName() + ".lock");
+    mLock->setStaleLockTime(0); // held for the whole session
+    if(!mLock->tryLock(0)) {
+        qWarning() << "failed to lock journal: " << mFile.fileName();
+        mFailed = true;
+    } else if(!mFile.open(QFile::WriteOnly | QFile::Append)) {
+#else
+    if(!mFile.open(QFile::WriteOnly | QFile::Append) || !lockFile(mFile)) {
+#endif
+        qWarning() << "failed to create journal: " << mFile.errorString();
+        mFailed = true;
+    }
+
+    mPending.open(QIODevice::WriteOnly);
+    mStream.setDevice(&mPending);
+    mStream.setVersion(QDataStream::Qt_4_6);
+
+    mTimer.setSingleShot(true);
+    mTimer.setInterval(FlushInterval);
+    connect(&mTimer, SIGNAL(timeout()), this, SLOT(flush()));
+
+    QFileInfo base(doc->path());
+    bool haveBase = !doc->path().isEmpty();
+    mStream << (quint32)Magic << doc->name() << doc->path()
+            << (qint64)(haveBase ? base.size() : 0)
+            << (haveBase ? base.lastModified() : QDateTime());
+    flush();
+}
+
+HexJournal::~HexJournal() {
+    waitForWrite();
+    mFile.close();
+    mFile.remove();
+#if QT_VERSION >= 0x050000
+    delete mLock; // unlocks and removes lock file
+#endif
+}
+
+QString HexJournal::directory() {
+#if QT_VERSION >= 0x050000
+    return QDir(QStandardPaths::writableLocation(QStandardPaths::DataLocation))
+            .filePath("journal");
+#else
+    return QDir(QDesktopServices::storageLocation(QDesktopServices::DataLocation))
+            .filePath("journal");
+#endif
+}
+
+void HexJournal::logInsert(OffType where, const HexUndoData &what) {
+    logData('I', where, what);
+}
+
+void HexJournal::logWrite(OffType where, const HexUndoData &what) {
+    logData('W', where, what);
+}
+
+void HexJournal::logDelete(OffType start, OffType end) {
+    if(mFailed) return;
+    mStream << (quint8)'D' << (qint64)start << (qint64)end;
+    if(mPending.size() >= MaxPending) flush();
+    else if(!mTimer.isActive()) mTimer.start();
+}
+
+void HexJournal::logData(quint8 type, OffType where, const HexUndoData &what) {
+    if(mFailed) return;
+    mStream << type << (qint64)where << (qint64)what.size();
+
+    int count = what.chunkCount();
+    if(what.size() < MaxPending) {
+        for(int i = 0; i < count; i++) {
+            QByteArray chunk = what.chunk(i);
+            mStream.writeRawData(chunk.constData(), chunk.size());
+        }
+        if(mPending.size() >= MaxPending) flush();
+        else if(!mTimer.isActive()) mTimer.start();
+        return;
+    }
+
+    // don't buffer huge payloads, pass them to writer chunk by chunk
+    // right after record header, reading next chunk while previous is written
+    flush();
+    for(int i = 0; i < count && !mFailed; i++)
+        write(what.chunk(i), i == count-1);
+}
+
+void HexJournal::flush() {
+    mTimer.stop();
+    if(mFailed || !mPending.size()) return;
+
+    QByteArray data = mPending.data();
+    mPending.buffer().clear();
+    mPending.seek(0);
+    write(data, true);
+}
+
+// one write at a time keeps records in order, waiting here only
+// when edits come faster than disk syncs them
+void HexJournal::write(const QByteArray &data, bool sync) {
+    waitForWrite();
+    if(mFailed) return;
+    mWriting = QtConcurrent::run(writeJournal, &mFile, data, sync);
+    mWritePending = true;
+}
+
+void HexJournal::waitForWrite() {
+    if(!mWritePending) return;
+    mWritePending = false;
+    if(!mWriting.result()) {
+        qWarning() << "failed to write journal: " << mFile.errorString();
+        mFailed = true; // torn record, nothing after it would replay anyway
+    }
+}
+
+bool HexJournal::readHeader(QDataStream &in, Header &header) {
+    quint32 magic;
+    in.setVersion(QDataStream::Qt_4_6);
+    in >> magic >> header.name >> header.path >> header.baseSize >> header.baseTime;
+    return in.status() == QDataStream::Ok && magic == Magic;
+}
+
+QStringList HexJournal::staleJournals() {
+    QStringList ret;
+    QDir dir(directory());
+    foreach(QString fileName, dir.entryList(QStringList() << "*.journal", QDir::Files, QDir::Time)) {
+        // journal is stale when nobody holds its lock, ours included
+        QString path = dir.filePath(fileName);
+#if QT_VERSION >= 0x050000
+        QLockFile lock(path + ".lock");
+        lock.setStaleLockTime(0); // only dead owner makes lock stale
+        if(!lock.tryLock(0)) continue;
+#else
+        QFile file(path);
+        if(!file.open(QFile::ReadOnly) || !lockFile(file)) continue;
+#endif
+        ret.append(path);
+    }
+    return ret;
+}
+
+QString HexJournal::describe(const QString &fileName) {
+    QFile file(fileName);
+    Header header;
+    if(!file.open(QFile::ReadOnly)) return fileName;
+    QDataStream in(&file);
+    if(!readHeader(in, header)) return fileName;
+
+    if(header.path.isEmpty())
+        return tr("'%1'").arg(header.name);
+
+    QFileInfo base(header.path);
+    if(base.size() != header.baseSize || base.lastModified() != header.baseTime)
+        return tr("'%1' (file was changed since, recovered data may be wrong)").arg(header.path);
+    return tr("'%1'").arg(header.path);
+}
+
+// rebuilds document from its base and journal, up to first incomplete record
+HexDocument *HexJournal::recover(const QString &fileName) {
+    QFile file(fileName);
+    if(!file.open(QFile::ReadOnly)) return 0;
+
+    QDataStream in(&file);
+    Header header;
+    if(!readHeader(in, header)) return 0;
+
+    HexDocument *doc;
+    if(header.path.isEmpty()) {
+        doc = new HexDocument;
+        doc->setName(header.name);
+    } else {
+        QFile base(header.path);
+        if(!base.open(QFile::ReadOnly)) return 0;
+        doc = new HexDocument(new HexBuffer(base.readAll()));
+        doc->setPath(header.path);
+    }
+
+    // replay goes through usual edit functions, so the document gets its own journal
+    for(;;) {
+        quint8 type;
+        qint64 where, size;
+        in >> type >> where >> size;
+        if(in.status() != QDataStream::Ok) break;
+
+        if(type == 'D') {
+            doc->del(where, size); // size is end offset here
+            continue;
+        }
+
+        HexUndoData data;
+        for(qint64 left = size; left > 0; ) {
+            QByteArray chunk(qMin(left, (qint64)HexUndoData::ChunkSize), 0);
+            if(in.readRawData(chunk.data(), chunk.size()) != chunk.size()) {
+                data.clear();
+                break;
+            }
+            data.append(chunk);
+            left -= chunk.size();
+        }
+        if(data.size() != size) break;
+
+        if(type == 'I') doc->paste(where, data);
+        else if(type == 'W') doc->pasteOver(where, data);
+        else break;
+    }
+    return doc;
+}
+
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+const char HexTextEncoder::mDigits[2][17] = {"0123456789abcdef", "0123456789ABCDEF"};
+
+QStringList HexTextEncoder::formatNames() {
+    // same order as Format
+    return QStringList() << QObject::tr("Raw bytes") << QObject::tr("Hex pairs")
+                         << QObject::tr("xxd dump") << QObject::tr("C array")
+                         << QObject::tr("Base64");
+}
+
+void HexTextEncoder::hexEncode(const uint8_t *src, int size, char *dst, bool upperCase) {
+    const char *digits = mDigits[upperCase];
+    int i = 0;
+
+#if defined(__AVX2__)
+    const __m256i lut = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)digits));
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    for(; i+32 <= size; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src+i));
+        __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), mask));
+        __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, mask));
+        // unpack works within 128-bit lanes, so put lanes back in order
+        __m256i a = _mm256_unpacklo_epi8(hi, lo);
+        __m256i b = _mm256_unpackhi_epi8(hi, lo);
+        _mm256_storeu_si256((__m256i*)(dst+2*i), _mm256_permute2x128_si256(a, b, 0x20));
+        _mm256_storeu_si256((__m256i*)(dst+2*i+32), _mm256_permute2x128_si256(a, b, 0x31));
+    }
+#elif defined(__SSSE3__)
+    const __m128i lut = _mm_loadu_si128((const __m128i*)digits);
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    for(; i+16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src+i));
+        __m128i hi = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(v, 4), mask));
+        __m128i lo = _mm_shuffle_epi8(lut, _mm_and_si128(v, mask));
+        _mm_storeu_si128((__m128i*)(dst+2*i), _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i*)(dst+2*i+16), _mm_unpackhi_epi8(hi, lo));
+    }
+#elif defined(__SSE2__)
+    // no byte shuffle: digit = nibble + '0' + (nibble > 9 ? letter offset : 0)
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i letter = _mm_set1_epi8(digits[10]-'0'-10);
+    for(; i+16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src+i));
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+        __m128i lo = _mm_and_si128(v, mask);
+        hi = _mm_add_epi8(_mm_add_epi8(hi, zero), _mm_and_si128(_mm_cmpgt_epi8(hi, nine), letter));
+        lo = _mm_add_epi8(_mm_add_epi8(lo, zero), _mm_and_si128(_mm_cmpgt_epi8(lo, nine), letter));
+        _mm_storeu_si128((__m128i*)(dst+2*i), _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i*)(dst+2*i+16), _mm_unpackhi_epi8(hi, lo));
+    }
+#endif
+
+    for(; i < size; i++) {
+        dst[2*i] = digits[src[i]>>4];
+        dst[2*i+1] = digits[src[i]&0xf];
+    }
+}
+
+// hexValueTable entries for non digits
+enum {
+    HexSeparator = 16,
+    HexBadChar = 255
+};
+
+static const uint8_t *hexValueTable() {
+    static uint8_t table[256];
+    static bool ready = false;
+    if(!ready) {
+        memset(table, HexBadChar, sizeof(table));
+        for(int c = 0; c < 10; c++) table['0'+c] = c;
+        for(int c = 0; c < 6; c++) table['a'+c] = table['A'+c] = 10+c;
+        table[(uint8_t)' '] = table[(uint8_t)'\t'] = table[(uint8_t)'\r'] =
+        table[(uint8_t)'\n'] = table[(uint8_t)':'] = HexSeparator;
+        ready = true;
+    }
+    return table;
+}
+
+qint64 HexTextEncoder::decodeHex(const char *src, qint64 size, QByteArray &out) {
+    const uint8_t *table = hexValueTable();
+    out.resize(size/2);
+    uint8_t *dst = (uint8_t*)out.data();
+    int pending = -1;	// high nibble waiting for its pair
+    qint64 i = 0;
+    qint64 scalarEnd = 0;	// where to try vector path again
+
+#ifdef __SSSE3__
+    // shuffles gathering high and low nibbles of "hh hh hh ..." text
+    // from three vectors, -128 zeroes output byte
+    static int8_t gather[2][3][16];
+    static bool haveGather = false;
+    if(!haveGather) {
+        for(int n = 0; n < 2; n++)
+            for(int v = 0; v < 3; v++)
+                for(int k = 0; k < 16; k++) {
+                    int at = 3*k+n-16*v;
+                    gather[n][v][k] = 0 <= at && at < 16 ? at : -128;
+                }
+        haveGather = true;
+    }
+#endif
+
+    while(i < size) {
+#ifdef __SSE2__
+        // 16 hex digits in a row are decoded at once, anything else goes
+        // through scalar loop for a block and we try again after it
+        if(pending < 0 && i >= scalarEnd && i+16 <= size) {
+            __m128i c = _mm_loadu_si128((const __m128i*)(src+i));
+            __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+            __m128i isDigit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0'-1)),
+                                            _mm_cmplt_epi8(c, _mm_set1_epi8('9'+1)));
+            __m128i isLetter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a'-1)),
+                                             _mm_cmplt_epi8(lower, _mm_set1_epi8('f'+1)));
+            if(_mm_movemask_epi8(_mm_or_si128(isDigit, isLetter)) == 0xffff) {
+                __m128i val = _mm_or_si128(_mm_and_si128(isDigit, c), _mm_andnot_si128(isDigit, lower));
+                val = _mm_sub_epi8(val, _mm_set1_epi8('0'));
+                val = _mm_sub_epi8(val, _mm_and_si128(isLetter, _mm_set1_epi8('a'-'0'-10)));
+                // even chars are high nibbles and sit in low byte of 16-bit lane
+                __m128i bytes = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(val, _mm_set1_epi16(0xff)), 4),
+                                             _mm_srli_epi16(val, 8));
+                _mm_storel_epi64((__m128i*)dst, _mm_packus_epi16(bytes, bytes));
+                dst += 8;
+                i += 16;
+                continue;
+            }
+        }
+#endif
+#ifdef __SSSE3__
+        // pairs separated by single space, colon or newline, 16 at once
+        if(pending < 0 && i >= scalarEnd && i+48 <= size) {
+            static const int sepMask[3] = {0x4924, 0x2492, 0x9249};
+            __m128i val[3];
+            bool match = true;
+            for(int v = 0; v < 3 && match; v++) {
+                __m128i c = _mm_loadu_si128((const __m128i*)(src+i+16*v));
+                __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+                __m128i isDigit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0'-1)),
+                                                _mm_cmplt_epi8(c, _mm_set1_epi8('9'+1)));
+                __m128i isLetter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a'-1)),
+                                                 _mm_cmplt_epi8(lower, _mm_set1_epi8('f'+1)));
+                __m128i isSep = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8(' ')),
+                                                          _mm_cmpeq_epi8(c, _mm_set1_epi8(':'))),
+                                             _mm_cmpeq_epi8(c, _mm_set1_epi8('\n')));
+                match = _mm_movemask_epi8(_mm_or_si128(isDigit, isLetter)) == (0xffff & ~sepMask[v]) &&
+                        _mm_movemask_epi8(isSep) == sepMask[v];
+                val[v] = _mm_or_si128(_mm_and_si128(isDigit, c), _mm_andnot_si128(isDigit, lower));
+                val[v] = _mm_sub_epi8(val[v], _mm_set1_epi8('0'));
+                val[v] = _mm_sub_epi8(val[v], _mm_and_si128(isLetter, _mm_set1_epi8('a'-'0'-10)));
+            }
+            if(match) {
+                __m128i hi = _mm_setzero_si128();
+                __m128i lo = _mm_setzero_si128();
+                for(int v = 0; v < 3; v++) {
+                    hi = _mm_or_si128(hi, _mm_shuffle_epi8(val[v], _mm_loadu_si128((const __m128i*)gather[0][v])));
+                    lo = _mm_or_si128(lo, _mm_shuffle_epi8(val[v], _mm_loadu_si128((const __m128i*)gather[1][v])));
+                }
+                _mm_storeu_si128((__m128i*)dst, _mm_or_si128(_mm_slli_epi16(hi, 4), lo));
+                dst += 16;
+                i += 48;
+                continue;
+            }
+        }
+#endif
+#ifdef __SSE2__
+        if(i >= scalarEnd) scalarEnd = i+16; // vector paths failed here
+#endif
+        uint8_t v = table[(uint8_t)src[i]];
+        if(v == HexBadChar) return i;
+        if(v == HexSeparator) {
+            if(pending >= 0) return i; // lone digit
+        } else if(pending < 0) {
+            pending = v;
+        } else {
+            *dst++ = (uint8_t)(pending<<4 | v);
+            pending = -1;
+        }
+        i++;
+    }
+
+    if(pending >= 0) return size;
+    out.resize(dst - (uint8_t*)out.constData());
+    return -1;
+}
+
+QByteArray HexTextEncoder::header() const {
+    if(mFormat == CArray) return "unsigned char data[] = {\n";
+    return QByteArray();
+}
+
+QByteArray HexTextEncoder::footer() const {
+    if(mFormat == CArray) return "};\n";
+    return QByteArray();
+}
+
+void HexTextEncoder::encode(const uint8_t *src, int size, OffType offset, QByteArray &out) const {
+    if(mFormat == Raw) {
+        out.append((const char*)src, size);
+        return;
+    }
+
+    if(mFormat == Base64) {
+        out.append(QByteArray::fromRawData((const char*)src, size).toBase64());
+        return;
+    }
+
+    // hex digits of whole chunk first, then spread them over lines
+    QByteArray hexArray(2*size, 0);
+    const char *hex = hexArray.constData();
+    hexEncode(src, size, hexArray.data());
+
+    // upper bound, xxd line has up to 16 digit offset
+    int lineSize = mFormat == Xxd ? 16+2+16*2+8+1+16+1 : mFormat == CArray ? 2+16*6 : 16*3;
+    int start = out.size();
+    out.resize(start + (size+15)/16*lineSize);
+    char *dst = out.data() + start;
+
+    for(int line = 0; line < size; line += 16, offset += 16) {
+        int n = qMin(16, size-line);
+        const char *h = hex + 2*line;
+
+        if(mFormat == HexPairs) {
+            for(int i = 0; i < n; i++) {
+                *dst++ = h[2*i];
+                *dst++ = h[2*i+1];
+                *dst++ = i+1 < n ? ' ' : '\n';
+            }
+        } else if(mFormat == CArray) {
+            *dst++ = ' ';
+            *dst++ = ' ';
+            for(int i = 0; i < n; i++) {
+                *dst++ = '0';
+                *dst++ = 'x';
+                *dst++ = h[2*i];
+                *dst++ = h[2*i+1];
+                *dst++ = ',';
+                *dst++ = i+1 < n ? ' ' : '\n';
+            }
+        } else {
+            int digits = offset >> 32 ? 16 : 8;
+            for(int i = digits-1; i >= 0; i--)
+                *dst++ = digit((offset >> (i*4)) & 0xf, false);
+            *dst++ = ':';
+            *dst++ = ' ';
+            for(int i = 0; i < 16; i++) {
+                *dst++ = i < n ? h[2*i] : ' ';
+                *dst++ = i < n ? h[2*i+1] : ' ';
+                if(i&1) *dst++ = ' ';
+            }
+            *dst++ = ' ';
+            for(int i = 0; i < n; i++) {
+                uint8_t c = src[line+i];
+                *dst++ = 0x20 <= c && c < 0x7f ? c : '.';
+            }
+            *dst++ = '\n';
+        }
+    }
+    out.resize(dst - out.constData());
+}
+
+QByteArray HexTextEncoder::encodeAll(const QByteArray &data, OffType offset) const {
+    QByteArray ret = header();
+    for(int i = 0; i < data.size(); i += ChunkSize)
+        encode((const uint8_t*)data.constData()+i, qMin((int)ChunkSize, data.size()-i),
+               offset+i, ret);
+    ret.append(footer());
+    return ret;
+}
+
+
+HexMimeData::HexMimeData(HexDocument *doc, OffType start, OffType end, const QString &format,
+                         HexTextEncoder::Format encoding)
+    : mEncoder(encoding)
+{
+    mDocument = doc;
+    mStart = start;
+    mEnd = end;
+    mFormat = format;
+    mHaveData = false;
+    mStore = new HexUndoStore;
+
+    if(doc->mModel->hasSharedPieces()) snapshot(); // free for such models
+    else connect(doc, SIGNAL(aboutToModify(OffType, OffType)), this, SLOT(snapshot(OffType, OffType)));
+}
+
+HexMimeData::HexMimeData(const HexUndoData &data, const QString &format)
+    : mEncoder(HexTextEncoder::Raw)
+{
+    mStart = 0;
+    mEnd = data.size();
+    mFormat = format;
+    mHaveData = true;
+    mStore = new HexUndoStore;
+
+    // spilled extents keep document's undo store alive
+    mData = data;
+}
+
+HexMimeData::~HexMimeData() {
+    mStore->destroy(); // after mData is gone, if it was spilled there
+}
+
+QStringList HexMimeData::formats() const {
+    return QStringList() << mFormat;
+}
+
+bool HexMimeData::hasFormat(const QString &mimeType) const {
+    return mimeType == mFormat;
+}
+
+// edits away from our range don't need a copy
+void HexMimeData::snapshot(OffType start, OffType end) {
+    if(start < mEnd && end > mStart) snapshot();
+}
+
+void HexMimeData::snapshot() {
+    if(mHaveData || !mDocument) return;
+    mDocument->capture(mStart, mEnd, mData, mStore);
+    mHaveData = true;
+    mDocument->disconnect(this);
+}
+
+HexUndoData HexMimeData::pieces() const {
+    if(mHaveData) return mData;
+
+    HexUndoData ret;
+    if(mDocument) mDocument->capture(mStart, mEnd, ret, mStore);
+    return ret;
+}
+
+QVariant HexMimeData::retrieveData(const QString &mimeType, QVariant::Type type) const {
+    Q_UNUSED(type);
+    if(mimeType != mFormat) return QVariant();
+
+    // pasting inside qhexed goes through pieces(), other apps get nothing
+    if(mEnd-mStart > mEncoder.maxInputSize()) {
+        qWarning() << "selection of" << mEnd-mStart << "bytes is too large for clipboard";
+        return QVariant();
+    }
+
+    QByteArray data;
+    if(mHaveData) data = mData.toByteArray();
+    else if(mDocument) data = mDocument->read(mStart, mEnd);
+    else return QVariant();
+
+    return mEncoder.encodeAll(data, mStart);
+}
+
+
+qint64 HexDocument::mUndoMemoryLimit = (qint64)HexSettings::defUndoMemory()*1024*1024;
+QHash<QString, HexDocument *> HexDocument::mFiles;
+
+HexDocument::HexDocument(QObject *parent)
+    : QObject(parent)
+{
+    mBuffer = true;
+    initFrom(new HexBuffer(this));
+
+    static int sequenceNumber = 1;
+    setName(tr("buffer%1").arg(sequenceNumber++));
+}
+
+HexDocument::HexDocument(HexDataModel *model, QObject *parent)
+    : QObject(parent)
+{
+
+    mBuffer = false;
+
+    if(!model->parent())
+        model->setParent(this);
+
+    initFrom(model);
+}
+
+HexDocument::~HexDocument() {
+    emit aboutToModify(0, mModel->getLength()); // last chance for lazy copies
+    if(!mFileKey.isEmpty()) mFiles.remove(mFileKey);
+    discardJournal();
+    delete mUndoStack; // commands may reference mUndoStore
+    if(mUndoStore) mUndoStore->destroy();
+    delete mOverview; // waits for its jobs
+    delete mCache;
+}
+
+#ifndef Q_OS_WIN
+#include <sys/stat.h>
+#endif
+
+// device and inode identify file under any name, canonical path is fallback
+static QString fileKey(const QString &path) {
+#ifndef Q_OS_WIN
+    struct stat st;
+    if(::stat(QFile::encodeName(path).constData(), &st) == 0)
+        return QString("%1:%2").arg((qulonglong)st.st_dev).arg((qulonglong)st.st_ino);
+#endif
+    return QFileInfo(path).canonicalFilePath();
+}
+
+HexDocument *HexDocument::openedFile(const QString &path) {
+    return mFiles.value(fileKey(path), 0);
+}
+
+void HexDocument::registerFile(const QString &path) {
+    if(!mFileKey.isEmpty()) mFiles.remove(mFileKey);
+    mFileKey = fileKey(path);
+    mFiles.insert(mFileKey, this);
+}
+
+void HexDocument::initFrom(HexDataModel *model) {
+    mModified = false;
+    mModel = model;
+    mReadOnly = !mModel->isWriteable();
+    mCacheSize = 0;
+    mCachePageSize = 0;
+    mCache = new HexCache(*mModel);
+    readSettings();
+    connect(HexSettings::instance(), SIGNAL(changed()), this, SLOT(readSettings()));
+    mCursor = new HexCursor(this);
+    mUndoStack = new QUndoStack(this);
+    mUndoIndex = 0;
+    connect(mUndoStack, SIGNAL(indexChanged(int)), this, SLOT(undoIndexChanged(int)));
+    mUndoStore = 0;
+    mJournal = 0;
+    mOverview = 0;
+    mRefs = 0; // this is last cuz our mCursor also references us
+}
+
+void HexDocument::readSettings() {
+    QSettings settings;
+    settings.beginGroup("HexDocument");
+    int cacheSize = settings.value("mCacheSize", HexSettings::defCacheSize()).toInt();
+    int cachePageSize = settings.value("mCachePageSize", HexSettings::defCachePageSize()).toInt();
+    int cacheBudget = settings.value("mCacheBudget", HexSettings::defCacheBudget()).toInt();
+    int undoMemory = settings.value("mUndoMemory", HexSettings::defUndoMemory()).toInt();
+    mTextFormat = settings.value("mTextFormat", HexSettings::defTextFormat()).toInt();
+    settings.endGroup();
+
+    mUndoMemoryLimit = (qint64)undoMemory*1024*1024;
+
+    if(mCacheSize > 0) cacheSize = mCacheSize;
+    if(mCachePageSize > 0) cachePageSize = mCachePageSize;
+    if(cachePageSize > 0) cachePageSize = qMax(cachePageSize, HexSettings::minCachePageSize());
+
+    HexCache::setGlobalBudget((OffType)cacheBudget*1024*1024);
+    mCache->setPageSize(cachePageSize);
+    mCache->setCacheSize((OffType)cacheSize*1024);
+}
+
+void HexDocument::setCacheLimits(int cacheSize, int pageSize) {
+    mCacheSize = qMax(0, cacheSize);
+    mCachePageSize = qMax(0, pageSize);
+    readSettings();
+}
+
+// only in memory buffers need journal, other models are written through
+HexJournal *HexDocument::journal() {
+    if(!mJournal && qobject_cast<HexBuffer*>(mModel))
+        mJournal = new HexJournal(this);
+    return mJournal;
+}
+
+void HexDocument::discardJournal() {
+    delete mJournal;
+    mJournal = 0;
+}
+
+HexUndoStore *HexDocument::undoStore() {
+    if(!mUndoStore) mUndoStore = new HexUndoStore;
+    return mUndoStore;
+}
+
+HexOverview *HexDocument::overview() {
+    if(!mOverview) mOverview = new HexOverview(this, this);
+    return mOverview;
+}
+
+bool HexDocument::maybeSave() {
+    if(mBuffer && mModified) {
+        int ret;
+        ret = QMessageBox::warning(qApp->activeWindow(), tr("Save Changes?"),
+                                   tr("'%1' has been modified.\n"
+                                      "Do you want to save your changes?")
+                                   .arg(userFriendlyName()),
+                                   QMessageBox::Yes, QMessageBox::No, QMessageBox::Cancel);
+        if (ret == QMessageBox::Yes)
+            return save();
+        else if (ret == QMessageBox::Cancel)
+            return false;
+    } else {
+        mCache->flush();
+    }
+    discardJournal();
+    return true;
+}
+
+bool HexDocument::save() {
+    bool ret;
+    if(mPath.isEmpty()) {
+        if(mBuffer)
+            ret = saveAs();
+        else {
+            mCache->flush();
+            ret = true;
+            setModified(false);
+        }
+    } else {
+        ret = saveFile(mPath);
+    }
+    return ret;
+}
+
+bool HexDocument::saveAs() {
+    QString fileName = QFileDialog::getSaveFileName(qApp->activeWindow(), tr("Save As"), mName);
+    if(fileName.isEmpty())
+        return false;
+
+    return saveFile(fileName);
+}
+
+bool HexDocument::saveFile(const QString &fileName) {
+    QFile file(fileName);
+    if (!file.open(QFile::WriteOnly)) {
+        QMessageBox::warning(qApp->activeWindow(), tr("Save failed!"),
+                             tr("Cannot write file %1:\n%2.")
+                             .arg(fileName)
+                             .arg(file.errorString()));
+        return false;
+    }
+
+    int length = mCache->getLength();
+
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    for(int i = 0; i < length; i++)
+        file.putChar((*mCache)[i]);
+    QApplication::restoreOverrideCursor();
+
+    setPath(fileName);
+    setModified(false);
+    discardJournal(); // saved file is the new base
+
+    return true;
+}
+
+void HexDocument::setModified(bool state) {
+    if(!state && mModified) {
+        mModified = false;
+        emit saved();
+    } else {
+        mModified = state;
+        if(mModified)
+            emit changed();
+    }
+}
+
+void HexDocument::setModified(OffType start, OffType end, OffType delta) {
+    emit rangeChanged(start, end, delta);
+    setModified(true);
+}
+
+QString HexDocument::name() {
+    return mName;
+}
+
+void HexDocument::setName(QString name) {
+    if(mName != name) {
+        mName = name;
+        emit nameChanged();
+    }
+}
+
+QString HexDocument::path() {
+    return mPath;
+}
+
+void HexDocument::setPath(QString path) {
+    if(mPath != path) {
+        mPath = path;
+        mName = QFileInfo(mPath).fileName();
+        emit nameChanged();
+    }
+}
+
+QString HexDocument::userFriendlyName() {
+    return mName;
+
+}
+
+void HexDocument::putByte(OffType offset, uint8_t byte) {
+    if(mReadOnly) {
+        QMessageBox::warning(qApp->activeWindow(), tr("Editing is disabled!"),
+            tr("Document you are trying to edit is readonly."));
+        return;
+    }
+    pushCommand(new HexReplaceBytes(offset, byte));
+}
+
+void HexDocument::pushCommand(HexUndoCommand *cmd) {
+    cmd->setDocument(this);
+    mUndoStack->push(cmd);
+    HexUndoCommand::limitMemory(mUndoMemoryLimit);
+}
+
+// commands run by push, undo or redo have changed what they keep in memory
+void HexDocument::undoIndexChanged(int index) {
+    for(int i = qMin(index, mUndoIndex); i < qMax(index, mUndoIndex); i++)
+        ((HexUndoCommand*)mUndoStack->command(i))->account();
+    // merged push leaves index as is but grows top command
+    if(index > 0 && index == mUndoIndex)
+        ((HexUndoCommand*)mUndoStack->command(index-1))->account();
+    mUndoIndex = index;
+}
 
 QAction *HexDocument::createRedoAction() {
     return mUndoStack->createRedoAction(mUndoStack, tr("&Redo"));
@@ -1384,6 +2684,12 @@ void HexDocument::undo() {
 }
 
 void HexDocument::paste(OffType where, const QByteArray &what) {
+    HexUndoData data;
+    data.append(what);
+    paste(where, data);
+}
+
+void HexDocument::paste(OffType where, const HexUndoData &what) {
     if(mReadOnly) {
         QMessageBox::warning(qApp->activeWindow(), tr("Editing is disabled!"),
             tr("Document you are trying to edit is readonly."));
@@ -1392,91 +2698,470 @@ void HexDocument::paste(OffType where, const QByteArray &what) {
 
     if(what.size()) {
         mCache->flush();
-        mCache->clear();
         if(cursor()->selectionSize())
             del();
-        mModel->paste(where, what);
-        setModified(true);
+        emit aboutToModify(where, mModel->getLength());
+        OffType oldLength = mModel->getLength();
+        mModel->pastePieces(where, what.pieces());
+        mCache->remap(where, mModel->getLength()-oldLength);
+        if(journal()) journal()->logInsert(where, what);
+        setModified(where, where+what.size(), mModel->getLength()-oldLength);
+    }
+}
+
+void HexDocument::pasteOver(OffType where, const QByteArray &what) {
+    HexUndoData data;
+    data.append(what);
+    pasteOver(where, data);
+}
+
+void HexDocument::pasteOver(OffType where, const HexUndoData &what) {
+    if(mReadOnly) {
+        QMessageBox::warning(qApp->activeWindow(), tr("Editing is disabled!"),
+            tr("Document you are trying to edit is readonly."));
+        return;
+    }
+
+    if(what.size()) {
+        emit aboutToModify(where, where+what.size());
+        mCache->flush();
+        OffType oldLength = mModel->getLength();
+        int count = what.chunkCount();
+        for(int i = 0; i < count; i++) {
+            QByteArray chunk = what.chunk(i);
+            mModel->pasteOver(where, chunk);
+            mCache->update(where, chunk.constData(), chunk.size());
+            where += chunk.size();
+        }
+        if(journal()) journal()->logWrite(where-what.size(), what);
+        setModified(where-what.size(), where, mModel->getLength()-oldLength);
+        cursor()->clearSelection();
+    }
+}
+
+void HexDocument::del(OffType start, OffType end) {
+    if(start == end) return;
+
+    if(mReadOnly) {
+        QMessageBox::warning(qApp->activeWindow(), tr("Editing is disabled!"),
+            tr("Document you are trying to edit is readonly."));
+        return;
+    }
+
+    emit aboutToModify(start, mModel->getLength());
+    mCache->flush();
+    OffType oldLength = mModel->getLength();
+    mModel->del(start, end);
+    mCache->remap(start, mModel->getLength()-oldLength);
+    if(journal()) journal()->logDelete(start, end);
+    setModified(start, end, mModel->getLength()-oldLength);
+    cursor()->clearSelection();
+}
+
+void HexDocument::cut(OffType start, OffType end, HexUndoData &data) {
+    data.clear();
+
+    if(mReadOnly) {
+        QMessageBox::warning(qApp->activeWindow(), tr("Editing is disabled!"),
+            tr("Document you are trying to edit is readonly."));
+        return;
+    }
+
+    if(start == end || start >= length()) return;
+
+    take(start, end, data);
+    qApp->clipboard()->setMimeData(new HexMimeData(data, "application/octet-stream"));
+}
+
+// removes [start, end) keeping removed bytes in data
+void HexDocument::take(OffType start, OffType end, HexUndoData &data) {
+    data.clear();
+    if(start == end) return;
+
+    if(mReadOnly) {
+        QMessageBox::warning(qApp->activeWindow(), tr("Editing is disabled!"),
+            tr("Document you are trying to edit is readonly."));
+        return;
+    }
+
+    capture(start, end, data);
+    del(start, end);
+}
+
+// saves [start, end) for undo, referencing model's pieces when possible
+void HexDocument::capture(OffType start, OffType end, HexUndoData &data, HexUndoStore *store) {
+    data.clear();
+    mCache->flush();
+    end = qMin(end, mModel->getLength());
+
+    // shared pieces cost nothing, copies of huge ranges go to disk as we
+    // make them
+    qint64 copied = 0;
+    for(OffType offset = start; offset < end; ) {
+        QList<QByteArray> pieces = mModel->pieces(offset, end, HexUndoData::ChunkSize, copied);
+        if(pieces.isEmpty()) break;
+        foreach(const QByteArray &piece, pieces) {
+            data.append(piece);
+            offset += piece.size();
+        }
+        if(mUndoMemoryLimit && copied > mUndoMemoryLimit) {
+            data.spill(store ? store : undoStore());
+            copied = 0;
+        }
+    }
+}
+
+void HexDocument::copy(OffType start, OffType end) {
+    qApp->clipboard()->setMimeData(new HexMimeData(this, start, end, "application/octet-stream"));
+}
+
+void HexDocument::copyAsText(OffType start, OffType end) {
+    HexTextEncoder encoder((HexTextEncoder::Format)mTextFormat);
+    if(end-start > encoder.maxInputSize()) {
+        QMessageBox::warning(qApp->activeWindow(), tr("Copy As Text"),
+            tr("Selection is too large to be copied as text, use Export Selection instead."));
+        return;
+    }
+    qApp->clipboard()->setMimeData(new HexMimeData(this, start, end, "text/plain",
+                                   (HexTextEncoder::Format)mTextFormat));
+}
+
+QByteArray HexDocument::read(OffType start, OffType end) {
+    mCache->flush();
+    return mModel->copy(start, qMin(end, mModel->getLength()));
+}
+
+QByteArray HexDocument::replaceBytes(OffType where, const QByteArray &with) {
+    emit aboutToModify(where, where+with.size());
+    QByteArray what(with.size(), 0);
+    for(int i = 0; i < with.size(); i++) {
+        what[i] = cache()->getByte(where+i);
+        cache()->putByte(where+i, (uint8_t)with[i]);
+    }
+    if(journal()) {
+        HexUndoData data;
+        data.append(with);
+        journal()->logWrite(where, data);
+    }
+    setModified(where, where+with.size(), 0);
+    cursor()->clearSelection();
+    return what;
+}
+
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+QString HexTransform::name() const {
+    switch(op) {
+    case Fill: return "fill selection";
+    case Xor: return "xor selection";
+    case Add: return "add to selection";
+    case Rotate: return "rotate selection bits";
+    default: return "swap selection bytes";
+    }
+}
+
+void HexTransform::apply(uint8_t *data, int size, OffType phase) const {
+    int i = 0;
+
+    if(op == Swap16 || op == Swap32 || op == Swap64) {
+        int width = op == Swap16 ? 2 : op == Swap32 ? 4 : 8;
+        size -= size%width;
+#ifdef __SSE2__
+        for(; i+16 <= size; i += 16) {
+            __m128i v = _mm_loadu_si128((__m128i*)(data+i));
+            v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+            if(width == 4) {
+                v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2,3,0,1));
+                v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2,3,0,1));
+            } else if(width == 8) {
+                v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0,1,2,3));
+                v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0,1,2,3));
+            }
+            _mm_storeu_si128((__m128i*)(data+i), v);
+        }
+#endif
+        for(; i < size; i += width)
+            for(int a = i, b = i+width-1; a < b; a++, b--)
+                qSwap(data[a], data[b]);
+        return;
+    }
+
+    if(op == Rotate) {
+        int n = bits & 7;
+        if(!n) return;
+#ifdef __SSE2__
+        // there are no 8-bit shifts, so shift 16-bit lanes and mask
+        __m128i count = _mm_cvtsi32_si128(n);
+        __m128i rcount = _mm_cvtsi32_si128(8-n);
+        __m128i hiMask = _mm_set1_epi8((char)(0xff<<n));
+        __m128i loMask = _mm_set1_epi8((char)(0xff>>(8-n)));
+        for(; i+16 <= size; i += 16) {
+            __m128i v = _mm_loadu_si128((__m128i*)(data+i));
+            __m128i hi = _mm_and_si128(_mm_sll_epi16(v, count), hiMask);
+            __m128i lo = _mm_and_si128(_mm_srl_epi16(v, rcount), loMask);
+            _mm_storeu_si128((__m128i*)(data+i), _mm_or_si128(hi, lo));
+        }
+#endif
+        for(; i < size; i++)
+            data[i] = (uint8_t)(data[i]<<n | data[i]>>(8-n));
+        return;
+    }
+
+    int keyLen = key.size();
+    if(!keyLen) return;
+
+    // key repeated 16 times starting at phase, so every 16 byte block
+    // of data has its key bytes at the same place in pattern
+    int patLen = keyLen*16;
+    QByteArray patArray(patLen, 0);
+    uint8_t *pat = (uint8_t*)patArray.data();
+    int keyPhase = phase%keyLen;
+    for(int k = 0; k < patLen; k++)
+        pat[k] = key.at((keyPhase+k)%keyLen);
+
+    if(op == Fill) {
+        for(; i < size; i += patLen)
+            memcpy(data+i, pat, qMin(patLen, size-i));
+        return;
+    }
+
+#ifdef __SSE2__
+    for(int p = 0; i+16 <= size; i += 16, p = (p+16)%patLen) {
+        __m128i v = _mm_loadu_si128((__m128i*)(data+i));
+        __m128i k = _mm_loadu_si128((__m128i*)(pat+p));
+        v = op == Xor ? _mm_xor_si128(v, k) : _mm_add_epi8(v, k);
+        _mm_storeu_si128((__m128i*)(data+i), v);
+    }
+#endif
+    for(; i < size; i++) {
+        uint8_t k = pat[i%patLen];
+        data[i] = op == Xor ? data[i]^k : data[i]+k;
+    }
+}
+
+static QByteArray runTransform(HexTransform transform, QByteArray chunk, OffType phase) {
+    transform.apply((uint8_t*)chunk.data(), chunk.size(), phase);
+    return chunk;
+}
+
+
+HexTransformJob::HexTransformJob(HexDocument *doc, OffType start, OffType end,
+                                 const HexTransform &transform, QWidget *parent)
+    : QObject(doc)
+{
+    mDocument = doc;
+    mTransform = transform;
+    mStart = start;
+    mEnd = qMin(end, doc->length());
+    mOffset = start;
+    mCancelled = false;
+
+    mProgress = new QProgressDialog(tr("Transforming %1 bytes...").arg(mEnd-mStart),
+                                    tr("Cancel"), 0, 1000, parent);
+    mProgress->setWindowModality(Qt::WindowModal); // document must stay intact
+    mProgress->setMinimumDuration(500);
+    connect(mProgress, SIGNAL(canceled()), this, SLOT(cancel()));
+    connect(&mWatcher, SIGNAL(finished()), this, SLOT(chunkDone()));
+}
+
+HexTransformJob::~HexTransformJob() {
+    mWatcher.waitForFinished();
+    delete mProgress;
+}
+
+void HexTransformJob::start() {
+    if(mStart >= mEnd) {
+        deleteLater();
+        return;
+    }
+    readNext(mStart);
+    runNext();
+}
+
+void HexTransformJob::readNext(OffType offset) {
+    mNext = mDocument->read(offset, qMin(mEnd, offset+HexUndoData::ChunkSize));
+    mOld.append(mNext);
+
+    qint64 limit = HexDocument::mUndoMemoryLimit;
+    if(limit && mOld.memoryUsage() > limit)
+        mOld.spill(mDocument->undoStore());
+}
+
+void HexTransformJob::runNext() {
+    mWatcher.setFuture(QtConcurrent::run(runTransform, mTransform, mNext, mOffset-mStart));
+    if(mOffset+mNext.size() < mEnd)
+        readNext(mOffset+mNext.size()); // overlaps with kernel
+}
+
+void HexTransformJob::chunkDone() {
+    if(mCancelled) {
+        rollback();
+        return;
+    }
+
+    QByteArray chunk = mWatcher.result();
+    mDocument->pasteOver(mOffset, chunk);
+    mOffset += chunk.size();
+    mProgress->setValue((int)((mOffset-mStart)*1000/(mEnd-mStart)));
+
+    if(mOffset >= mEnd) finish();
+    else runNext();
+}
+
+void HexTransformJob::cancel() {
+    mCancelled = true;
+}
+
+void HexTransformJob::finish() {
+    mProgress->reset();
+    mDocument->pushCommand(new HexTransformBytes(mStart, mEnd, mTransform, mOld));
+    deleteLater();
+}
+
+void HexTransformJob::rollback() {
+    // mOld has originals of every chunk read, including unwritten ones
+    mDocument->pasteOver(mStart, mOld);
+    deleteLater();
+}
+
+
+HexSearch::HexSearch(const QByteArray &inPattern)
+    : pattern(inPattern)
+{
+    int n = pattern.size();
+    for(int i = 0; i < 256; i++)
+        skip[i] = qMax(n, 1);
+    for(int i = 0; i < n-1; i++)
+        skip[(uint8_t)pattern.at(i)] = n-1-i;
+}
+
+int HexSearch::find(const uint8_t *data, int size) const {
+    int n = pattern.size();
+    if(!n || size < n) return -1;
+    const uint8_t *pat = (const uint8_t*)pattern.constData();
+
+    if(n == 1) {
+        const uint8_t *hit = (const uint8_t*)memchr(data, pat[0], size);
+        return hit ? (int)(hit-data) : -1;
+    }
+
+    int i = 0;
+#ifdef __SSE2__
+    if(n <= MaxFilterSize) {
+        __m128i first = _mm_set1_epi8((char)pat[0]);
+        __m128i last = _mm_set1_epi8((char)pat[n-1]);
+        for(; i+n-1+16 <= size; i += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(data+i));
+            __m128i b = _mm_loadu_si128((const __m128i*)(data+i+n-1));
+            int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first),
+                                                       _mm_cmpeq_epi8(b, last)));
+            // candidates in ascending order, so first verified one is the match
+            for(int bit = 0; mask; bit++, mask >>= 1)
+                if((mask&1) && !memcmp(data+i+bit+1, pat+1, n-2))
+                    return i+bit;
+        }
+    }
+#endif
+    return horspool(data, i, size);
+}
+
+int HexSearch::horspool(const uint8_t *data, int from, int size) const {
+    int n = pattern.size();
+    const uint8_t *pat = (const uint8_t*)pattern.constData();
+    for(int i = from; i+n <= size; i += skip[data[i+n-1]]) {
+        if(data[i+n-1] == pat[n-1] && !memcmp(data+i, pat, n-1))
+            return i;
     }
+    return -1;
 }
 
-void HexDocument::pasteOver(OffType where, const QByteArray &what) {
-    if(mReadOnly) {
-        QMessageBox::warning(qApp->activeWindow(), tr("Editing is disabled!"),
-            tr("Document you are trying to edit is readonly."));
-        return;
-    }
+static int runSearch(HexSearch search, QByteArray chunk) {
+    return search.find((const uint8_t*)chunk.constData(), chunk.size());
+}
 
-    if(what.size()) {
-        mCache->flush();
-        mCache->clear();
-        mModel->pasteOver(where, what);
-        setModified(true);
-        cursor()->clearSelection();
-    }
+
+HexFindJob::HexFindJob(HexDocument *doc, OffType start, const HexSearch &search, QWidget *parent)
+    : QObject(doc)
+{
+    mDocument = doc;
+    mSearch = search;
+    mStart = start;
+    mEnd = doc->length();
+    mOffset = start;
+    mChunkSize = 0;
+    mCancelled = false;
+
+    mProgress = new QProgressDialog(tr("Searching %1 bytes...").arg(qMax((OffType)0, mEnd-mStart)),
+                                    tr("Cancel"), 0, 1000, parent);
+    mProgress->setWindowModality(Qt::WindowModal); // offsets must stay valid
+    mProgress->setMinimumDuration(500);
+    connect(mProgress, SIGNAL(canceled()), this, SLOT(cancel()));
+    connect(&mWatcher, SIGNAL(finished()), this, SLOT(chunkDone()));
 }
 
-void HexDocument::del(OffType start, OffType end) {
-    if(start == end) return;
+HexFindJob::~HexFindJob() {
+    mWatcher.waitForFinished();
+    delete mProgress;
+}
 
-    if(mReadOnly) {
-        QMessageBox::warning(qApp->activeWindow(), tr("Editing is disabled!"),
-            tr("Document you are trying to edit is readonly."));
+void HexFindJob::start() {
+    if(mStart+mSearch.size() > mEnd) {
+        finish(-1);
         return;
     }
+    readNext(mStart);
+    runNext();
+}
 
-    mModel->del(start, end);
-    setModified(true);
-    cursor()->clearSelection();
+void HexFindJob::readNext(OffType offset) {
+    // pattern must fit into chunk with room to advance
+    OffType size = qMax((OffType)ChunkSize, (OffType)mSearch.size()*2);
+    mNext = mDocument->read(offset, qMin(mEnd, offset+size));
 }
 
-QByteArray HexDocument::cut(OffType start, OffType end) {
+void HexFindJob::runNext() {
+    mChunkSize = mNext.size();
+    mWatcher.setFuture(QtConcurrent::run(runSearch, mSearch, mNext));
+    OffType next = mOffset+mChunkSize;
+    if(next < mEnd)
+        readNext(next-(mSearch.size()-1)); // overlaps with search
+}
 
-    if(mReadOnly) {
-        QMessageBox::warning(qApp->activeWindow(), tr("Editing is disabled!"),
-            tr("Document you are trying to edit is readonly."));
-        return QByteArray();
+void HexFindJob::chunkDone() {
+    if(mCancelled) {
+        mProgress->reset();
+        deleteLater();
+        return;
     }
 
-    if(start == end) return QByteArray();
-
-    mCache->flush();
-    if(start >= mModel->getLength()) return QByteArray();
-    mCache->clear();
+    int hit = mWatcher.result();
+    if(hit >= 0) {
+        finish(mOffset+hit);
+        return;
+    }
 
-    QMimeData *mimeData = new QMimeData;
-    QByteArray ret = mModel->cut(start, end);
-    mimeData->setData("application/octet-stream", ret);
-    qApp->clipboard()->setMimeData(mimeData);
-    setModified(true);
-    cursor()->clearSelection();
-    return ret;
-}
+    OffType next = mOffset+mChunkSize;
+    if(next >= mEnd) {
+        finish(-1);
+        return;
+    }
 
-QByteArray HexDocument::copy(OffType start, OffType end) {
-    mCache->flush();
-    QMimeData *mimeData = new QMimeData;
-    QByteArray ret = mModel->copy(start, end);
-    mimeData->setData("application/octet-stream", ret);
-    qApp->clipboard()->setMimeData(mimeData);
-    return ret;
+    mOffset = next-(mSearch.size()-1);
+    mProgress->setValue((int)((mOffset-mStart)*1000/(mEnd-mStart)));
+    runNext();
 }
 
-QByteArray HexDocument::copyAsText(OffType start, OffType end) {
-    mCache->flush();
-    QMimeData *mimeData = new QMimeData;
-    QByteArray ret = mModel->copy(start, end);
-    mimeData->setData("text/plain", ret);
-    qApp->clipboard()->setMimeData(mimeData);
-    return ret;
+void HexFindJob::cancel() {
+    mCancelled = true;
 }
 
-uint8_t HexDocument::replaceByte(OffType where, uint8_t with) {
-    uint8_t what = (*cache())[where];
-    (*cache())[where] = with;
-    setModified(true);
-    cursor()->clearSelection();
-    return what;
+void HexFindJob::finish(OffType offset) {
+    mProgress->reset();
+    emit found(offset);
+    deleteLater();
 }
 
 
@@ -1733,12 +3418,6 @@ bool HexWidget::saveAs() {return d->saveAs();}
 //////////////////////////////////// Private Stuff ///////////////////////////////////////
 
 
-static inline int binToHex(int b, bool upperCase=true) {
-    if(upperCase) return b < 10 ? b+'0' : b-10+'A';
-    else return b < 10 ? b+'0' : b-10+'a';
-}
-
-
 static inline int hexToBin(int b) {
     if('0' <= b && b <= '9') return b-'0';
     else if('A' <= b && b <= 'F') return b-'A'+10;
@@ -1751,10 +3430,8 @@ static inline QString RectToString(QRect r) {
            arg(r.width()).arg(r.height());
 }
 
-uint qHash(const HexCellDesc &cd) {
-    return cd.hash();
-}
 
+QList<HexWidgetPrivate *> HexWidgetPrivate::mInstanceList;
 
 HexWidgetPrivate::HexWidgetPrivate(HexWidget *pub, HexDocument *doc)
     : QFrame(pub)
@@ -1762,19 +3439,10 @@ HexWidgetPrivate::HexWidgetPrivate(HexWidget *pub, HexDocument *doc)
     mPublic = pub;
 
     setFrameStyle(QFrame::Panel | QFrame::Sunken);
-    mCacheSize = 512;
-
-    pixes = new CharPix[mCacheSize];
-    for(int i = 0; i < mCacheSize; i++) {
-        if(i) pixes[i].prev = &pixes[i-1];
-        else pixes[i].prev = 0;
-
-        if(i+1 < mCacheSize) pixes[i].next = &pixes[i+1];
-        else pixes[i].next = 0;
-    }
-    lru = &pixes[0];
-    mru = &pixes[mCacheSize-1];
 
+    mStyleSerial = 0;
+    mRenderMode = HexSettings::defRenderMode();
+    mAtlas = 0;
     mCellSide = -1;
     readSettings();
 
@@ -1797,6 +3465,11 @@ HexWidgetPrivate::HexWidgetPrivate(HexWidget *pub, HexDocument *doc)
     connect(saveAsAct, SIGNAL(triggered()), this, SLOT(saveAs()));
     mFileActions.append(saveAsAct);
 
+    cacheAct = new QAction(tr("&Cache Settings..."), this);
+    cacheAct->setStatusTip(tr("Set cache size for this document"));
+    connect(cacheAct, SIGNAL(triggered()), this, SLOT(editCacheSettings()));
+    mFileActions.append(cacheAct);
+
     undoAct = document()->createUndoAction();
     undoAct->setShortcut(tr("Ctrl+Z"));
     undoAct->setIcon(QIcon(":/images/undo.png"));
@@ -1842,6 +3515,40 @@ HexWidgetPrivate::HexWidgetPrivate(HexWidget *pub, HexDocument *doc)
     connect(pasteOverAct, SIGNAL(triggered()), this, SLOT(pasteOver()));
     mEditActions.append(pasteOverAct);
 
+    pasteHexAct = new QAction(tr("Paste &Hex"), this);
+    pasteHexAct->setShortcut(tr("Ctrl+Shift+V"));
+    pasteHexAct->setStatusTip(tr("Decode clipboard's hex text and paste it into current selection"));
+    connect(pasteHexAct, SIGNAL(triggered()), this, SLOT(pasteHex()));
+    mEditActions.append(pasteHexAct);
+
+    pasteHexOverAct = new QAction(tr("Paste Hex O&ver"), this);
+    pasteHexOverAct->setShortcut(tr("Ctrl+Shift+O"));
+    pasteHexOverAct->setStatusTip(tr("Decode clipboard's hex text and paste it over data under cursor"));
+    connect(pasteHexOverAct, SIGNAL(triggered()), this, SLOT(pasteHexOver()));
+    mEditActions.append(pasteHexOverAct);
+
+    exportAct = new QAction(tr("&Export Selection..."), this);
+    exportAct->setStatusTip(tr("Save selected data as raw bytes, hex dump, C array or base64"));
+    connect(exportAct, SIGNAL(triggered()), this, SLOT(exportSelection()));
+    mFileActions.append(exportAct);
+
+    transformAct = new QAction(tr("T&ransform Selection..."), this);
+    transformAct->setStatusTip(tr("Fill, xor, add, rotate or byte swap selected data"));
+    connect(transformAct, SIGNAL(triggered()), this, SLOT(transformSelection()));
+    mEditActions.append(transformAct);
+
+    findAct = new QAction(tr("&Find..."), this);
+    findAct->setShortcut(tr("Ctrl+F"));
+    findAct->setStatusTip(tr("Search document for bytes or text"));
+    connect(findAct, SIGNAL(triggered()), this, SLOT(find()));
+    mEditActions.append(findAct);
+
+    findNextAct = new QAction(tr("Find &Next"), this);
+    findNextAct->setShortcut(tr("F3"));
+    findNextAct->setStatusTip(tr("Search for next occurrence of last searched bytes"));
+    connect(findNextAct, SIGNAL(triggered()), this, SLOT(findNext()));
+    mEditActions.append(findNextAct);
+
     // we use our own private cursor shared between all views
     mCursor = new HexCursor(doc, this);
 
@@ -1867,6 +3574,8 @@ HexWidgetPrivate::HexWidgetPrivate(HexWidget *pub, HexDocument *doc)
     layout->addWidget(new Column(mOffsetView));
     layout->addWidget(new Column(mDataView));
     layout->addWidget(new Column(mTextView));
+    mMinimap = new HexMinimap(this);
+    layout->addWidget(new Column(mMinimap));
 
     //QSplitter *splitter = new QSplitter(this);
     //splitter->addWidget(hexOffsetView);
@@ -1878,8 +3587,8 @@ HexWidgetPrivate::HexWidgetPrivate(HexWidget *pub, HexDocument *doc)
 }
 
 HexWidgetPrivate::~HexWidgetPrivate() {
-    delete [] pixes;
     mInstanceList.removeAll(this);
+    HexGlyphCache::instance()->release(mAtlas);
     document()->release();
 }
 
@@ -1914,12 +3623,20 @@ void HexWidgetPrivate::updateActions() {
         copyAsTextAct->setEnabled(true);
         pasteAct->setEnabled(isEditable() && document()->isCuttable());
         pasteOverAct->setEnabled(isEditable());
+        pasteHexAct->setEnabled(isEditable() && document()->isCuttable());
+        pasteHexOverAct->setEnabled(isEditable());
+        transformAct->setEnabled(isEditable());
+        exportAct->setEnabled(true);
     } else {
         cutAct->setEnabled(false);
         copyAct->setEnabled(false);
         copyAsTextAct->setEnabled(false);
         pasteAct->setEnabled(isEditable() && document()->isCuttable());
         pasteOverAct->setEnabled(isEditable());
+        pasteHexAct->setEnabled(isEditable() && document()->isCuttable());
+        pasteHexOverAct->setEnabled(isEditable());
+        transformAct->setEnabled(false);
+        exportAct->setEnabled(false);
     }
 }
 
@@ -1931,6 +3648,171 @@ bool HexWidgetPrivate::saveAs() {
     return document()->saveAs();
 }
 
+void HexWidgetPrivate::editCacheSettings() {
+    bool ok;
+    int cacheSize = QInputDialog::getInt(this, tr("Cache Settings"),
+        tr("Cache size for %1 in KiB (0 - use global setting):").arg(document()->name()),
+        document()->cacheSizeLimit(), 0, 64*1024*1024, 1, &ok);
+    if(!ok) return;
+
+    int pageSize = QInputDialog::getInt(this, tr("Cache Settings"),
+        tr("Cache page size in bytes (0 - use global setting):"),
+        document()->cachePageSizeLimit(), 0, 16*1024*1024, 1, &ok);
+    if(!ok) return;
+
+    document()->setCacheLimits(cacheSize, pageSize);
+}
+
+void HexWidgetPrivate::transformSelection() {
+    if(!cursor()->hasSelection()) return;
+
+    QStringList ops;
+    ops << tr("Fill with pattern")
+        << tr("XOR with key")
+        << tr("Add key")
+        << tr("Rotate bits left")
+        << tr("Swap bytes of 16-bit words")
+        << tr("Swap bytes of 32-bit words")
+        << tr("Swap bytes of 64-bit words");
+
+    bool ok;
+    QString item = QInputDialog::getItem(this, tr("Transform Selection"),
+        tr("Operation:"), ops, 0, false, &ok);
+    if(!ok) return;
+
+    HexTransform transform((HexTransform::Op)ops.indexOf(item));
+
+    if(transform.op == HexTransform::Fill || transform.op == HexTransform::Xor ||
+       transform.op == HexTransform::Add) {
+        QString key = QInputDialog::getText(this, tr("Transform Selection"),
+            tr("Key as hex bytes (e.g. DE AD BE EF):"), QLineEdit::Normal, QString(), &ok);
+        if(!ok) return;
+        QByteArray text = key.toLatin1();
+        qint64 bad = HexTextEncoder::decodeHex(text.constData(), text.size(), transform.key);
+        if(bad >= 0) {
+            QMessageBox::warning(this, tr("Transform Selection"),
+                tr("Key isn't valid hex:\nbad character at offset %1.").arg(bad));
+            return;
+        }
+        if(transform.key.isEmpty()) {
+            QMessageBox::warning(this, tr("Transform Selection"), tr("Key is empty."));
+            return;
+        }
+    } else if(transform.op == HexTransform::Rotate) {
+        transform.bits = QInputDialog::getInt(this, tr("Transform Selection"),
+            tr("Bits to rotate left:"), 1, 1, 7, 1, &ok);
+        if(!ok) return;
+    }
+
+    HexTransformJob *job = new HexTransformJob(document(), cursor()->selectionStart(),
+                                               cursor()->selectionEnd(), transform, this);
+    job->start();
+}
+
+void HexWidgetPrivate::find() {
+    QStringList kinds;
+    kinds << tr("Hex bytes") << tr("Text");
+
+    bool ok;
+    QString kind = QInputDialog::getItem(this, tr("Find"),
+        tr("Search for:"), kinds, 0, false, &ok);
+    if(!ok) return;
+
+    bool hex = kinds.indexOf(kind) == 0;
+    QString text = QInputDialog::getText(this, tr("Find"),
+        hex ? tr("Bytes as hex (e.g. DE AD BE EF):") : tr("Text:"),
+        QLineEdit::Normal, QString(), &ok);
+    if(!ok) return;
+
+    QByteArray pattern;
+    if(hex) {
+        QByteArray latin = text.toLatin1();
+        qint64 bad = HexTextEncoder::decodeHex(latin.constData(), latin.size(), pattern);
+        if(bad >= 0) {
+            QMessageBox::warning(this, tr("Find"),
+                tr("Pattern isn't valid hex:\nbad character at offset %1.").arg(bad));
+            return;
+        }
+    } else pattern = text.toLocal8Bit();
+    if(pattern.isEmpty()) {
+        QMessageBox::warning(this, tr("Find"), tr("Nothing to search for."));
+        return;
+    }
+
+    mFindPattern = pattern;
+    startFind(cursor()->position());
+}
+
+void HexWidgetPrivate::findNext() {
+    if(mFindPattern.isEmpty()) {
+        find();
+        return;
+    }
+    // skip match under cursor
+    startFind(cursor()->hasSelection() ? cursor()->selectionStart()+1 : cursor()->position()+1);
+}
+
+void HexWidgetPrivate::startFind(OffType from) {
+    HexFindJob *job = new HexFindJob(document(), from, HexSearch(mFindPattern), this);
+    connect(job, SIGNAL(found(OffType)), this, SLOT(showFound(OffType)));
+    job->start();
+}
+
+void HexWidgetPrivate::showFound(OffType offset) {
+    if(offset < 0) {
+        QMessageBox::information(this, tr("Find"), tr("No more matches till end of document."));
+        return;
+    }
+
+    cursor()->setCursor(offset, offset+mFindPattern.size());
+    if(!mDataView->inView(offset))
+        cursor()->setTop(offset-offset%mCols);
+}
+
+void HexWidgetPrivate::exportSelection() {
+    if(!cursor()->hasSelection()) return;
+
+    QStringList formats = HexTextEncoder::formatNames();
+    bool ok;
+    QString item = QInputDialog::getItem(this, tr("Export Selection"),
+        tr("Format:"), formats, 0, false, &ok);
+    if(!ok) return;
+
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Export Selection"));
+    if(fileName.isEmpty()) return;
+
+    QFile file(fileName);
+    if(!file.open(QFile::WriteOnly)) {
+        QMessageBox::warning(this, tr("Export failed!"),
+                             tr("Cannot write file %1:\n%2.")
+                             .arg(fileName)
+                             .arg(file.errorString()));
+        return;
+    }
+
+    HexTextEncoder encoder((HexTextEncoder::Format)formats.indexOf(item));
+    OffType start = cursor()->selectionStart();
+    OffType end = cursor()->selectionEnd();
+
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    bool failed = file.write(encoder.header()) < 0;
+    QByteArray out;
+    for(OffType offset = start; offset < end && !failed; offset += HexTextEncoder::ChunkSize) {
+        QByteArray chunk = document()->read(offset, qMin(end, offset+HexTextEncoder::ChunkSize));
+        out.clear();
+        encoder.encode((const uint8_t*)chunk.constData(), chunk.size(), offset, out);
+        failed = file.write(out) != out.size();
+    }
+    failed = failed || file.write(encoder.footer()) < 0;
+    QApplication::restoreOverrideCursor();
+
+    if(failed)
+        QMessageBox::warning(this, tr("Export failed!"),
+                             tr("Cannot write file %1:\n%2.")
+                             .arg(fileName)
+                             .arg(file.errorString()));
+}
+
 void HexWidgetPrivate::closeEvent(QCloseEvent *event) {
     int refs = 0;
 
@@ -1975,6 +3857,14 @@ void HexWidgetPrivate::pasteOver() {
     cursor()->pasteOver();
 }
 
+void HexWidgetPrivate::pasteHex() {
+    cursor()->pasteHex();
+}
+
+void HexWidgetPrivate::pasteHexOver() {
+    cursor()->pasteHexOver();
+}
+
 QWidget *HexWidgetPrivate::configPanel() {
     return HexSettings::instance()->configPanel();
 }
@@ -1982,102 +3872,218 @@ QWidget *HexWidgetPrivate::configPanel() {
 
 
 void HexWidgetPrivate::readSettings() {
-    QSettings settings;
-    settings.beginGroup("HexWidget");
+    mStyleSerial++;
 
-    QFont newFont = settings.value("mFont", HexSettings::defFont()).value<QFont>();
+    QFont newFont;
+    QColor palette[ColorCount];
+    readLook(newFont, palette);
+    int newCellSide = cellSideFor(newFont, &mCellMargin);
 
+    QSettings settings;
+    settings.beginGroup("HexWidget");
     LOAD_INT(mCols, HexSettings::defCols());
     LOAD_INT(mGroupCols, HexSettings::defGroupCols());
+    LOAD_INT(mRenderMode, HexSettings::defRenderMode());
+    LOAD_INT(mByteClasses, HexSettings::defByteClasses());
+    settings.endGroup();
 
-    LOAD_COLOR(mOffsetFg,	HexSettings::defOffsetFg());
-    LOAD_COLOR(mOffsetBg,	HexSettings::defOffsetBg());
-    LOAD_COLOR(mDataFgEven,	HexSettings::defDataFgEven());
-    LOAD_COLOR(mDataFgOdd,	HexSettings::defDataFgOdd());
-    LOAD_COLOR(mDataBgEven,	HexSettings::defDataBgEven());
-    LOAD_COLOR(mDataBgOdd,	HexSettings::defDataBgOdd());
-    LOAD_COLOR(mTextFgEven,	HexSettings::defTextFgEven());
-    LOAD_COLOR(mTextBgEven,	HexSettings::defTextBgEven());
-    LOAD_COLOR(mTextFgOdd,	HexSettings::defTextFgOdd());
-    LOAD_COLOR(mTextBgOdd,	HexSettings::defTextBgOdd());
-    LOAD_COLOR(mSelFg,		HexSettings::defSelFg());
-    LOAD_COLOR(mSelBg,		HexSettings::defSelBg());
-    LOAD_COLOR(mCursorFg,	HexSettings::defCursorFg());
-    LOAD_COLOR(mCursorBg,	HexSettings::defCursorBg());
+    for(int i = 0; i < ColorCount; i++)
+        mPalette[i] = palette[i];
+    buildByteStyles();
+
+    // other widgets have likely switched to the new look already,
+    // release after acquire so unchanged atlas isn't dropped in between
+    HexGlyphCache *cache = HexGlyphCache::instance();
+    HexGlyphAtlas *atlas = cache->acquire(newFont, newCellSide, mPalette, ColorCount);
+    if(mAtlas) cache->release(mAtlas);
+    mAtlas = atlas;
+
+    if(newCellSide != mCellSide || newFont != mFont) {
+        mCellSide = newCellSide;
+        mFont = newFont;
+        adjustSize();
+        update();
+        emit cellFontChanged();
+    }
+    update();
+}
+
+#define LOAD_ROLE(role) palette[role] = settings.value("m" #role, HexSettings::def##role()).value<QColor>();
+
+void HexWidgetPrivate::readLook(QFont &font, QColor *palette) {
+    QSettings settings;
+    settings.beginGroup("HexWidget");
+
+    font = settings.value("mFont", HexSettings::defFont()).value<QFont>();
+
+    LOAD_ROLE(OffsetFg);
+    LOAD_ROLE(OffsetBg);
+    LOAD_ROLE(DataFgEven);
+    LOAD_ROLE(DataFgOdd);
+    LOAD_ROLE(DataBgEven);
+    LOAD_ROLE(DataBgOdd);
+    LOAD_ROLE(TextFgEven);
+    LOAD_ROLE(TextBgEven);
+    LOAD_ROLE(TextFgOdd);
+    LOAD_ROLE(TextBgOdd);
+    LOAD_ROLE(SelFg);
+    LOAD_ROLE(SelBg);
+    LOAD_ROLE(CursorFg);
+    LOAD_ROLE(CursorBg);
+    LOAD_ROLE(ZeroFg);
+    LOAD_ROLE(FullFg);
+    LOAD_ROLE(PrintableFg);
+    LOAD_ROLE(ControlFg);
+    LOAD_ROLE(HighFg);
 
     settings.endGroup();
+}
 
+int HexWidgetPrivate::cellSideFor(const QFont &font, int *margin) {
     static char hexChars[] = "0123456789ABCDEF";
 
-    QFontMetrics fontMetrics(newFont);
-    int newCellSide = fontMetrics.ascent();
+    QFontMetrics fontMetrics(font);
+    int cellSide = fontMetrics.ascent();
     for(int i = 0; i < 16; i++) {
         int width = fontMetrics.width(hexChars[i])
             /*+ fontMetrics.leftBearing(ch)
             + fontMetrics.rightBearing(ch)*/;
-        if(width > newCellSide)
-            newCellSide = width;
+        if(width > cellSide)
+            cellSide = width;
     }
 
-    mCellMargin = (int)(newCellSide/1.5);
-    newCellSide += mCellMargin; // additional margin for readability
-    newCellSide += newCellSide&1; // make even
+    *margin = (int)(cellSide/1.5);
+    cellSide += *margin; // additional margin for readability
+    cellSide += cellSide&1; // make even
+    return cellSide;
+}
 
-    if(newCellSide != mCellSide || newFont != mFont) {
-        mCellSide = newCellSide;
-        mFont = newFont;
-        clearFontCache();
-        adjustSize();
-        update();
-        emit cellFontChanged();
+// styles every widget draws right after opening a document
+QList<HexCellDesc> HexWidgetPrivate::commonStyles(bool byteClasses) {
+    QList<HexCellDesc> styles;
+    styles << HexCellDesc(0, OffsetFg, OffsetBg);
+
+    QList<int> dataFg, textFg;
+    if(byteClasses) {
+        dataFg << ZeroFg << FullFg << PrintableFg << ControlFg << HighFg;
+        textFg = dataFg;
+    } else {
+        dataFg << DataFgEven << DataFgOdd;
+        textFg << TextFgEven << TextFgOdd;
     }
-    update();
+    int dataBg[] = {DataBgEven, DataBgOdd};
+    int textBg[] = {TextBgEven, TextBgOdd};
+    for(int b = 0; b < 2; b++) {
+        foreach(int fg, dataFg) {
+            HexCellDesc l(0, fg, dataBg[b]);
+            HexCellDesc r(l);
+            l.setAlignment(HexCellDesc::LEFT);
+            r.setAlignment(HexCellDesc::RIGHT);
+            styles << l << r;
+        }
+        foreach(int fg, textFg)
+            styles << HexCellDesc(0, fg, textBg[b]);
+    }
+    return styles;
 }
 
-
-void HexWidgetPrivate::clearFontCache() {
-    mPixHash.clear();
-    for(int i = 0; i < mCacheSize; i++)
-        if(pixes[i].cd.isValid()) {
-            pixes[i].cd.makeInvalid();
-            pixes[i].pix = QPixmap();
+void HexWidgetPrivate::prewarmGlyphs() {
+    QFont font;
+    QColor palette[ColorCount];
+    readLook(font, palette);
+    QSettings settings;
+    bool byteClasses = settings.value("HexWidget/mByteClasses", HexSettings::defByteClasses()).toInt();
+    int margin;
+    HexGlyphCache::instance()->prewarm(font, cellSideFor(font, &margin),
+                                       palette, ColorCount, commonStyles(byteClasses));
+}
+
+int HexWidgetPrivate::byteClass(int byte) {
+    if(byte == 0x00) return ZeroFg;
+    if(byte == 0xff) return FullFg;
+    if(byte >= 0x80) return HighFg;
+    if(byte < 0x20 || byte == 0x7f) return ControlFg;
+    return PrintableFg;
+}
+
+// resolved once per settings change, drawRow() just indexes the tables
+void HexWidgetPrivate::buildByteStyles() {
+    for(int byte = 0; byte < 256; byte++) {
+        if(mByteClasses) {
+            int fg = byteClass(byte);
+            mDataFg[0][byte] = mDataFg[1][byte] = fg;
+            mTextFg[0][byte] = mTextFg[1][byte] = fg;
+        } else {
+            mDataFg[0][byte] = DataFgEven;
+            mDataFg[1][byte] = DataFgOdd;
+            mTextFg[0][byte] = TextFgEven;
+            mTextFg[1][byte] = TextFgOdd;
         }
+    }
 }
 
-QPixmap HexWidgetPrivate::fetchCell(const HexCellDesc &cd) {
-    Q_ASSERT(cd.isValid());
 
-    if(mru->cd == cd) return mru->pix;
+HexGlyphAtlas::HexGlyphAtlas(const QByteArray &key, const QFont &font, int cellSide,
+                             const QColor *palette, int colorCount)
+    : mKey(key), mFont(font), mCellSide(cellSide)
+{
+    for(int i = 0; i < colorCount && i < PaletteSize; i++)
+        mPalette[i] = palette[i];
+    mPixmapDirty = false;
+    mStripCount = 0;
+    for(int i = 0; i < HexCellDesc::StyleCount; i++)
+        mStrips[i] = -1;
+    mRefs = 0;
+}
+
+const QPixmap &HexGlyphAtlas::pixmap() {
+    if(mPixmapDirty) {
+        mPixmap = QPixmap::fromImage(mImage);
+        mPixmapDirty = false;
+    }
+    return mPixmap;
+}
 
-    CharPix *pix;
-    QHash<HexCellDesc, CharPix*>::iterator it = mPixHash.find(cd);
-    if(it != mPixHash.end()) {
-        pix = *it;
-        if(pix->prev) // if not leastRecentlyUsed
-            pix->prev->next = pix->next;
-        else
-            lru = pix->next;
-    } else {
-        pix = lru;
-        lru = pix->next;
-        lru->prev = 0;
-        mPixHash.erase(mPixHash.find(pix->cd));
-        pix->cd = cd;
-        mPixHash[pix->cd] = pix;
-        pix->pix = drawFontCell(pix->cd);
-    }
-    pix->next->prev = pix->prev;
-    pix->prev = mru;
-    mru->next = pix;
-    mru = pix;
-    mru->next = 0;
-    return pix->pix;
-}
-
-QPixmap HexWidgetPrivate::drawFontCell(const HexCellDesc &cd) {
-    QColor fg, bg;
+QRect HexGlyphAtlas::cellRect(const HexCellDesc &cd) {
+    int strip = mStrips[cd.style()];
+    if(strip < 0) strip = addStrip(cd);
+    return QRect(cd.value()*charWidth(), strip*mCellSide, charWidth(), mCellSide);
+}
+
+void HexGlyphAtlas::addStrips(const QList<HexCellDesc> &styles) {
+    foreach(const HexCellDesc &style, styles)
+        if(mStrips[style.style()] < 0) addStrip(style);
+}
+
+// QImage and text rasterization into it work in any thread, QPixmap doesn't
+int HexGlyphAtlas::addStrip(const HexCellDesc &style) {
+    int strip = mStripCount++;
+
+    if((strip+1)*mCellSide > mImage.height()) {
+        // grow twice, strips already drawn keep their place
+        QImage image(256*charWidth(), qMax(16, strip*2)*mCellSide, QImage::Format_RGB32);
+        if(!mImage.isNull()) {
+            QPainter painter(&image);
+            painter.drawImage(0, 0, mImage);
+        }
+        mImage = image;
+    }
+    mPixmapDirty = true;
+
+    QPainter painter(&mImage);
+    painter.setFont(mFont);
+    HexCellDesc cd(style);
+    for(int i = 0; i < 256; i++) {
+        cd.setValue(i);
+        drawCell(painter, QRect(i*charWidth(), strip*mCellSide, charWidth(), mCellSide), cd);
+    }
+
+    mStrips[style.style()] = strip;
+    return strip;
+}
+
+void HexGlyphAtlas::drawCell(QPainter &painter, const QRect &rect, const HexCellDesc &cd) {
     int ch = cd.value();
-    int width = charWidth();
 
     int flags;
     switch(cd.alignment()) {
@@ -2095,25 +4101,90 @@ QPixmap HexWidgetPrivate::drawFontCell(const HexCellDesc &cd) {
         ;
     }
 
-    QPixmap pix(width, mCellSide);
-    QPainter painter(&pix);
-    painter.fillRect(pix.rect(), cd.bg());
+    painter.fillRect(rect, mPalette[cd.bg()]);
 
     QFontMetrics fontMetrics(mFont);
     if(ch != ' ' && fontMetrics.inFont(ch)) {
-        painter.setFont(mFont);
-        painter.setPen(cd.fg());
-        painter.drawText(QRect(0, 0, width-1, mCellSide), flags, QString(ch));
+        painter.setPen(mPalette[cd.fg()]);
+        painter.drawText(QRect(rect.x(), rect.y(), rect.width()-1, rect.height()),
+                         flags, QString(ch));
     }
 
     if(cd.frameEnabled()) {
         // non-focus cursor frame
-        painter.setPen(mCursorBg);
+        painter.setPen(mPalette[HexWidgetPrivate::CursorBg]);
         painter.setBrush(Qt::NoBrush);
-        painter.drawRect(0,0,width-1,mCellSide-1);
+        painter.drawRect(rect.x(), rect.y(), rect.width()-1, rect.height()-1);
+    }
+}
+
+
+HexGlyphCache *HexGlyphCache::mInstance = 0;
+
+HexGlyphCache *HexGlyphCache::instance() {
+    if(!mInstance) mInstance = new HexGlyphCache;
+    return mInstance;
+}
+
+QByteArray HexGlyphCache::key(const QFont &font, int cellSide,
+                              const QColor *palette, int colorCount) {
+    QByteArray key = font.toString().toUtf8();
+    key.append((char *)&cellSide, sizeof(cellSide));
+    for(int i = 0; i < colorCount; i++) {
+        QRgb rgb = palette[i].rgba();
+        key.append((char *)&rgb, sizeof(rgb));
+    }
+    return key;
+}
+
+HexGlyphAtlas *HexGlyphCache::acquire(const QFont &font, int cellSide,
+                                      const QColor *palette, int colorCount) {
+    QByteArray key = HexGlyphCache::key(font, cellSide, palette, colorCount);
+    HexGlyphAtlas *atlas = mAtlases.value(key);
+    if(atlas) {
+        atlas->mWarming.waitForFinished(); // worker no longer touches it
+        mUnused.removeAll(atlas);
+    } else {
+        atlas = new HexGlyphAtlas(key, font, cellSide, palette, colorCount);
+        mAtlases.insert(key, atlas);
     }
+    atlas->mRefs++;
+    return atlas;
+}
+
+void HexGlyphCache::release(HexGlyphAtlas *atlas) {
+    if(--atlas->mRefs) return;
+    mUnused.append(atlas);
+    trim();
+}
+
+static void warmAtlas(HexGlyphAtlas *atlas, QList<HexCellDesc> styles) {
+    atlas->addStrips(styles);
+}
+
+void HexGlyphCache::prewarm(const QFont &font, int cellSide, const QColor *palette,
+                            int colorCount, const QList<HexCellDesc> &styles) {
+    // text can't be drawn outside gui thread on some platforms (e.g. X11
+    // without xcb threads), strips are then rasterized on first paint
+    if(!QFontDatabase::supportsThreadedFontRendering()) return;
+    QByteArray key = HexGlyphCache::key(font, cellSide, palette, colorCount);
+    if(mAtlases.contains(key)) return;
 
-    return pix;
+    // atlas belongs to the worker until acquire() waits for it
+    HexGlyphAtlas *atlas = new HexGlyphAtlas(key, font, cellSide, palette, colorCount);
+    mAtlases.insert(key, atlas);
+    mUnused.append(atlas);
+    atlas->mWarming = QtConcurrent::run(warmAtlas, atlas, styles);
+    trim();
+}
+
+void HexGlyphCache::trim() {
+    while(mUnused.size() > MaxUnused) {
+        HexGlyphAtlas *atlas = mUnused.takeFirst();
+        atlas->mWarming.waitForFinished();
+        mAtlases.remove(atlas->key());
+        delete atlas;
+    }
 }
 
 
@@ -2124,12 +4195,25 @@ HexView::HexView(HexWidgetPrivate *p, Qt::WindowFlags f)
 {
     setFocusPolicy(Qt::StrongFocus);
     setAutoFillBackground(false);
+    setAttribute(Qt::WA_OpaquePaintEvent); // every pixel is painted, scroll can blit
     setSizePolicy(QSizePolicy::Preferred, QSizePolicy::Expanding);
+    mCells.reserve(4096); // keeps capacity across frames
+    mTarget = 0;
+    mTargetY = 0;
+    mRowCache.setMaxCost(RowCacheSize);
+    mRowSerial = -1;
+    mRowHits = 0;
+    mRowMisses = 0;
+    mSelStart = cursor()->selectionStart();
+    mSelEnd = cursor()->selectionEnd();
+    mPosition = cursor()->position();
+    mTop = start();
 
     connect(parent(), SIGNAL(cellFontChanged()), this, SLOT(updateSize()));
     connect(cursor(), SIGNAL(changed()), this, SLOT(cursorChanged()));
-    connect(cursor(), SIGNAL(topChanged()), this, SLOT(update()));
-    connect(document(), SIGNAL(changed()), this, SLOT(updateView()));
+    connect(cursor(), SIGNAL(topChanged()), this, SLOT(topChanged()));
+    connect(document(), SIGNAL(rangeChanged(OffType, OffType, OffType)),
+            this, SLOT(documentChanged(OffType, OffType, OffType)));
 }
 
 HexView::~HexView() {
@@ -2149,20 +4233,211 @@ void HexView::updateSize() {
     updateView();
 }
 
-void HexView::updateView() {
-    update();
+void HexView::updateView() {
+    update();
+}
+
+// cursor moves and blinking are repainted right away
+void HexView::updateRange(OffType start, OffType end, OffType delta) {
+    QRect rect = visibleRect(start, end, delta);
+    if(!rect.isEmpty()) update(rect);
+}
+
+// document edits are coalesced into scheduler's frames
+void HexView::documentChanged(OffType start, OffType end, OffType delta) {
+    QRect rect = visibleRect(start, end, delta);
+    if(!rect.isEmpty()) HexRepaintScheduler::instance()->update(this, rect);
+}
+
+QRect HexView::visibleRect(OffType start, OffType end, OffType delta) {
+    // shifted tail has to be redrawn down to the bottom
+    if(delta) end = qMax(end, this->end());
+    start = qMax(start, this->start());
+    end = qMin(end, this->end());
+    return start < end ? rangeToRect(start, end) : QRect();
+}
+
+// whole rows covering [start, end), which must be in view
+QRect HexView::rangeToRect(OffType start, OffType end) {
+    int first = (start-this->start())/cols();
+    int last = (end-1-this->start())/cols();
+    return QRect(0, first*parent()->charHeight(),
+                 width(), (last-first+1)*parent()->charHeight());
+}
+
+const char *HexView::readFrame(OffType start, OffType end) {
+    int size = (int)qMax((OffType)0, end-start);
+    if(mFrame.size() < size) mFrame.resize(size);
+    document()->cache()->read(start, (uint8_t*)mFrame.data(), size);
+    return mFrame.constData();
+}
+
+void HexView::addCell(int x, int y, const HexCellDesc &cd) {
+    QRect source = parent()->cellRect(cd);
+
+    if(mTarget) {
+        // atlas may have grown in cellRect(), so take it after
+        const QImage &atlas = parent()->atlasImage();
+        int srcStride = atlas.bytesPerLine();
+        int dstStride = mTarget->bytesPerLine();
+        const uchar *src = atlas.constBits() + source.y()*srcStride + source.x()*4;
+        uchar *dst = mTarget->bits() + (mTargetY+y)*dstStride + x*4;
+        for(int line = 0; line < source.height(); line++) {
+            memcpy(dst, src, source.width()*4);
+            src += srcStride;
+            dst += dstStride;
+        }
+        return;
+    }
+
+    // fragment position is the center of target rectangle
+    mCells.append(QPainter::PixmapFragment::create(
+        QPointF(x+source.width()/2.0, y+source.height()/2.0), source));
+}
+
+void HexView::drawCells(QPainter &painter) {
+    if(mCells.isEmpty()) return;
+    painter.drawPixmapFragments(mCells.constData(), mCells.size(), parent()->atlas());
+    mCells.resize(0);
+}
+
+void HexView::paintRows(QPainter &painter, const QRect &dirty, int cursorLook) {
+    OffType selStart = 1;
+    OffType selEnd = 0;
+
+    if(cursor()->hasSelection()) {
+        selStart = cursor()->selectionStart();
+        selEnd = cursor()->selectionEnd();
+    }
+
+    // only rows intersecting dirty rectangle
+    int cols = this->cols();
+    int rowHeight = parent()->charHeight();
+    int firstRow = dirty.top()/rowHeight;
+    int lastRow = dirty.bottom()/rowHeight;
+    OffType len = length();
+    OffType frameStart = start()+(OffType)firstRow*cols;
+    OffType endOffset = qMin(end(), start()+(OffType)(lastRow+1)*cols);
+    if(frameStart >= endOffset) return;
+
+    // whole frame at once, rows refer into it
+    const char *frame = readFrame(frameStart, qMin(endOffset, len));
+
+    bool scanline = parent()->renderMode() == HexWidgetPrivate::ScanlineRender;
+    int top = firstRow*rowHeight;
+    if(scanline) {
+        int frameHeight = (int)((endOffset-frameStart+cols-1)/cols)*rowHeight;
+        if(mImage.width() != widgetWidth() || mImage.height() < frameHeight)
+            mImage = QImage(widgetWidth(), qMax(frameHeight, height()), QImage::Format_RGB32);
+        mTarget = &mImage;
+    }
+
+    int y = top;
+    for(OffType offset = frameStart; offset < endOffset; offset += cols) {
+        int count = (int)qBound((OffType)0, len-offset, (OffType)cols);
+        QByteArray bytes = QByteArray::fromRawData(frame+(offset-frameStart), count);
+
+        if(scanline) {
+            // cells go straight into frame image, no row cache needed
+            mTargetY = y-top;
+            drawRow(painter, offset, bytes, selStart, selEnd, cursorLook);
+        } else {
+            QByteArray key = rowKey(offset, bytes, selStart, selEnd, cursorLook);
+            QPixmap row;
+            if(!findRow(key, row)) {
+                row = QPixmap(widgetWidth(), rowHeight);
+                QPainter rowPainter(&row);
+                drawRow(rowPainter, offset, bytes, selStart, selEnd, cursorLook);
+                rowPainter.end();
+                insertRow(key, row);
+            }
+            painter.drawPixmap(0, y, row);
+        }
+        y += rowHeight;
+    }
+
+    if(scanline) {
+        mTarget = 0;
+        painter.drawImage(QPoint(0, top), mImage, QRect(0, 0, mImage.width(), y-top));
+    }
+}
+
+// selection and cursor are clamped to the row, so rows away from them match
+QByteArray HexView::rowKey(OffType offset, const QByteArray &bytes,
+                           OffType selStart, OffType selEnd, int cursorLook) {
+    OffType cols = this->cols();
+    OffType position = cursor()->position();
+
+    qint32 header[5];
+    header[0] = (qint32)qBound((OffType)-1, selStart-offset, cols+1);
+    header[1] = (qint32)qBound((OffType)-1, selEnd-offset, cols+1);
+    header[2] = offset <= position && position < offset+cols ? (qint32)(position-offset) : -1;
+    header[3] = header[2] < 0 ? 0 : cursorLook;
+    header[4] = (qint32)((offset/cols)%2) | (offset == 0) << 1;
+
+    QByteArray key((const char*)header, sizeof(header));
+    key += bytes;
+    return key;
+}
+
+bool HexView::findRow(const QByteArray &key, QPixmap &row) {
+    if(mRowSerial != parent()->styleSerial()) {
+        mRowCache.clear();
+        mRowSerial = parent()->styleSerial();
+    }
+
+    QPixmap *cached = mRowCache.object(key);
+    if(!cached) {
+        mRowMisses++;
+        return false;
+    }
+    mRowHits++;
+    row = *cached;
+    return true;
+}
+
+void HexView::insertRow(const QByteArray &key, const QPixmap &row) {
+    int cost = row.width()*row.height()*row.depth()/8/1024 + 1;
+    mRowCache.insert(key, new QPixmap(row), cost);
 }
 
 void HexView::cursorChanged() {
     OffType selStart = cursor()->selectionStart();
     OffType selEnd = cursor()->selectionEnd();
+    OffType position = cursor()->position();
+
+    // selection edges that moved and both cursor cells
+    updateRange(qMin(selStart, mSelStart), qMax(selStart, mSelStart), 0);
+    updateRange(qMin(selEnd, mSelEnd), qMax(selEnd, mSelEnd), 0);
+    if(position != mPosition) {
+        updateRange(mPosition, mPosition+1, 0);
+        updateRange(position, position+1, 0);
+    }
 
-    bool newSelectionVisible = inView(selStart) || inView(selEnd);
+    mSelStart = selStart;
+    mSelEnd = selEnd;
+    mPosition = position;
+}
+
+// moves pixels already on screen, so only exposed rows are painted
+void HexView::topChanged() {
+    OffType delta = start()-mTop;
+    mTop = start();
 
-    if (newSelectionVisible || newSelectionVisible != mSelectionVisible)
+    OffType rows = delta/cols();
+    if(delta%cols() || qAbs(rows) >= this->rows()) {
         update();
+        return;
+    }
+    int dy = -(int)rows*parent()->charHeight();
+    // queued rects are in pre-scroll coordinates, Qt only moves its own
+    HexRepaintScheduler::instance()->scroll(this, 0, dy);
+    QWidget::scroll(0, dy);
+}
 
-    mSelectionVisible = newSelectionVisible;
+void HexView::updateCursorCell() {
+    OffType position = cursor()->position();
+    updateRange(position, position+1, 0);
 }
 
 QSize HexView::sizeHint() const {
@@ -2304,6 +4579,8 @@ HexOffsetView::HexOffsetView(HexWidgetPrivate *p, Qt::WindowFlags f)
     : HexView(p, f)
 {
     connect(document(), SIGNAL(changed()), this, SLOT(documentChanged()));
+    // offsets do not depend on cursor
+    disconnect(cursor(), SIGNAL(changed()), this, SLOT(cursorChanged()));
     setSizePolicy(QSizePolicy(QSizePolicy::Fixed, QSizePolicy::Expanding));
     updateSize();
 }
@@ -2444,25 +4721,28 @@ void HexOffsetView::paintEvent(QPaintEvent * event) {
 
     int cols = HexView::cols();
     int offsz = offsetSize();
-    OffType endOffset = end();
-    int y = 0;
-
+    int firstRow = event->rect().top()/parent()->charHeight();
+    int lastRow = event->rect().bottom()/parent()->charHeight();
+    OffType endOffset = qMin(end(), start()+(OffType)(lastRow+1)*cols);
+    int y = firstRow*parent()->charHeight();
 
-    for(OffType offset = start(); offset < endOffset; offset += cols) {
+    for(OffType offset = start()+(OffType)firstRow*cols; offset < endOffset; offset += cols) {
         int x = 0;
         for(int i = offsz-1; i >= 0; i--) {
             if(i != offsz-1 && !((i+1)%4)) {
-                painter.drawPixmap(x, y, parent()->fetchCell(
-                            HexCellDesc(':', parent()->offsetFg(), parent()->offsetBg())));
+                addCell(x, y, HexCellDesc(':', HexWidgetPrivate::OffsetFg, HexWidgetPrivate::OffsetBg));
                 x += charWidth();
             }
-            char digit = binToHex((int)((offset >> (i*4))&0xf));
-            painter.drawPixmap(x, y, parent()->fetchCell(
-                        HexCellDesc(digit,  parent()->offsetFg(), parent()->offsetBg())));
+            char digit = HexTextEncoder::digit((int)((offset >> (i*4))&0xf));
+            addCell(x, y, HexCellDesc(digit, HexWidgetPrivate::OffsetFg, HexWidgetPrivate::OffsetBg));
             x += charWidth();
         }
         y += parent()->charHeight();
     }
+    drawCells(painter);
+
+    if(width() > widgetWidth())
+        painter.fillRect(widgetWidth(), 0, width()-widgetWidth(), height(), parent()->offsetBg());
 }
 
 
@@ -2488,7 +4768,7 @@ HexDataView::HexDataView(HexWidgetPrivate *p, Qt::WindowFlags f)
 void HexDataView::cursorFlash() {
     if (QApplication::focusWidget() == this) {
         mCursorFlash = !mCursorFlash;
-        update();
+        updateCursorCell();
     } else {
         mCursorFlash = 0;
     }
@@ -2568,84 +4848,81 @@ void HexDataView::input(char ch) {
         mCursorSubPos = 1;
         setCursorFlash(false);
         setCursorFlash(true);
-        update();
+        updateCursorCell();
     }
 }
 
 void HexDataView::paintEvent(QPaintEvent * event) {
-    OffType selStart = 1;
-    OffType selEnd = 0;
-
-    if (cursor()->hasSelection()) {
-        selStart = cursor()->selectionStart();
-        selEnd = cursor()->selectionEnd();
-    }
-
     QPainter painter(this);
 
-    int cols = HexView::cols();
-    OffType endOffset = end();
-    OffType len = length();
+    // 0 - no cursor, 1 - frame, 2 - inverted cell, plus nibble in bit 2
+    int cursorLook = 0;
     bool haveFocus = QApplication::focusWidget() == this;
-    int y = 0;
+    if (parent()->isEditable())
+        cursorLook = (!haveFocus || mCursorFlash ? 1 : 2) | mCursorSubPos << 2;
 
-    for (OffType offset = start(); offset < endOffset; offset += cols) {
-        QColor bg((offset/cols)%2 ? parent()->dataBgOdd() : parent()->dataBgEven());
+    paintRows(painter, event->rect(), cursorLook);
 
-        int x = 0;
-        for (int i = 0; i < cols; i++) {
-            QColor fg(i%2 ? parent()->dataFgOdd(): parent()->dataFgEven());
-            HexCellDesc l, r;
-            l.setAlignment(l.LEFT);
-            r.setAlignment(r.RIGHT);
-
-            if (selStart <= offset+i && offset+i < selEnd) {
-                l.setFgBg(parent()->selFg(), parent()->selBg());
-                r.setFgBg(parent()->selFg(), parent()->selBg());
-            } else {
-                l.setFgBg(fg, bg);
-                r.setFgBg(fg, bg);
-            }
+    if (width() > widgetWidth())
+        painter.fillRect(widgetWidth(), 0, width()-widgetWidth(), height(), parent()->dataBgEven());
+}
 
-            if (!(i % groupCols()) && i) { // draw group separator?
-                HexCellDesc scd(l);
-                scd.setValue(' ');
+void HexDataView::drawRow(QPainter &painter, OffType offset, const QByteArray &bytes,
+                          OffType selStart, OffType selEnd, int cursorLook) {
+    int cols = HexView::cols();
+    int bg = (offset/cols)%2 ? HexWidgetPrivate::DataBgOdd : HexWidgetPrivate::DataBgEven;
+
+    int x = 0;
+    for (int i = 0; i < cols; i++) {
+        uint8_t byte = i < bytes.size() ? bytes[i] : 0;
+        int fg = parent()->dataFg(i&1)[byte];
+        HexCellDesc l, r;
+        l.setAlignment(l.LEFT);
+        r.setAlignment(r.RIGHT);
+
+        if (selStart <= offset+i && offset+i < selEnd) {
+            l.setFgBg(HexWidgetPrivate::SelFg, HexWidgetPrivate::SelBg);
+            r.setFgBg(HexWidgetPrivate::SelFg, HexWidgetPrivate::SelBg);
+        } else {
+            l.setFgBg(fg, bg);
+            r.setFgBg(fg, bg);
+        }
 
-                OffType prevOff = offset+i-1;
-                if (!prevOff || selStart > prevOff || prevOff > selEnd)
-                    scd.setFgBg(fg, bg);
+        if (!(i % groupCols()) && i) { // draw group separator?
+            HexCellDesc scd(l);
+            scd.setValue(' ');
 
-                QPixmap pix = parent()->fetchCell(scd);
-                painter.drawPixmap(x, y, pix);
-                x += charWidth();
-                painter.drawPixmap(x, y, pix);
-                x += charWidth();
-            }
+            OffType prevOff = offset+i-1;
+            if (!prevOff || selStart > prevOff || prevOff > selEnd)
+                scd.setFgBg(fg, bg);
 
-            if (offset+i < len) {
-                uint8_t byte = (*document())[offset+i];
-                l.setValue(binToHex(byte>> 4));
-                r.setValue(binToHex(byte&0xf));
-            } else {
-                l.setValue(' ');
-                r.setValue(' ');
-            }
+            addCell(x, 0, scd);
+            x += charWidth();
+            addCell(x, 0, scd);
+            x += charWidth();
+        }
 
-            if (offset+i == cursor()->position() && parent()->isEditable()) {
-                HexCellDesc &cd = mCursorSubPos ? r : l;
+        if (i < bytes.size()) {
+            l.setValue(HexTextEncoder::digit(byte>> 4));
+            r.setValue(HexTextEncoder::digit(byte&0xf));
+        } else {
+            l.setValue(' ');
+            r.setValue(' ');
+        }
 
-                if (!haveFocus || mCursorFlash) cd.enableFrame(true);
-                else cd.setFgBg(parent()->cursorFg(), parent()->cursorBg());
-            }
+        if (offset+i == cursor()->position() && cursorLook) {
+            HexCellDesc &cd = cursorLook&4 ? r : l;
 
-            painter.drawPixmap(x, y, parent()->fetchCell(l));
-            x += charWidth();
-            painter.drawPixmap(x, y, parent()->fetchCell(r));
-            x += charWidth();
+            if ((cursorLook&3) == 1) cd.enableFrame(true);
+            else cd.setFgBg(HexWidgetPrivate::CursorFg, HexWidgetPrivate::CursorBg);
         }
 
-        y += parent()->charHeight();
+        addCell(x, 0, l);
+        x += charWidth();
+        addCell(x, 0, r);
+        x += charWidth();
     }
+    drawCells(painter);
 }
 
 
@@ -2707,7 +4984,7 @@ HexTextView::HexTextView(HexWidgetPrivate *parent, Qt::WindowFlags f)
 void HexTextView::cursorFlash() {
     if (QApplication::focusWidget() == this) {
         mCursorFlash = !mCursorFlash;
-        update();
+        updateCursorCell();
     } else {
         mCursorFlash = 0;
     }
@@ -2767,56 +5044,58 @@ OffType HexTextView::relativeToGlobal(int rel) {
 }
 
 void HexTextView::paintEvent(QPaintEvent * event) {
-    OffType selStart = 1;
-    OffType selEnd = 0;
-
-    if(cursor()->hasSelection()) {
-        selStart = cursor()->selectionStart();
-        selEnd = cursor()->selectionEnd();
-    }
-
     QPainter painter(this);
 
-    int cols = HexView::cols();
-    OffType len = length();
-    OffType endOffset = end();
+    // 0 - no cursor, 1 - frame, 2 - inverted cell
+    int cursorLook = 0;
     bool haveFocus = QApplication::focusWidget() == this;
-    int y = 0;
-
-    //fprintf(stderr, "%d\n", width());
-    for(OffType offset = start(); offset < endOffset; offset += cols) {
-        QColor bg((offset/cols)%2 ? parent()->textBgOdd() : parent()->textBgEven());
-
-        int x = 0;
-        for(int i = 0; i < cols; i++) {
-            QColor fg(i%2 ? parent()->textFgOdd(): parent()->textFgEven());
-            HexCellDesc cd;
+    if(parent()->isEditable())
+        cursorLook = !haveFocus || mCursorFlash ? 1 : 2;
+
+    paintRows(painter, event->rect(), cursorLook);
+
+    // right margin keeps row colors
+    if(width() > widgetWidth()) {
+        int rowHeight = parent()->charHeight();
+        for(int row = event->rect().top()/rowHeight; row <= event->rect().bottom()/rowHeight; row++) {
+            OffType offset = start()+(OffType)row*cols();
+            QColor bg((offset/cols())%2 ? parent()->textBgOdd() : parent()->textBgEven());
+            painter.fillRect(widgetWidth(), row*rowHeight, width()-widgetWidth(), rowHeight, bg);
+        }
+    }
+}
 
-            if(selStart <= offset+i && offset+i < selEnd)
-                cd.setFgBg(parent()->selFg(), parent()->selBg());
-            else
-                cd.setFgBg(fg, bg);
+void HexTextView::drawRow(QPainter &painter, OffType offset, const QByteArray &bytes,
+                          OffType selStart, OffType selEnd, int cursorLook) {
+    int cols = HexView::cols();
+    int bg = (offset/cols)%2 ? HexWidgetPrivate::TextBgOdd : HexWidgetPrivate::TextBgEven;
 
-            if(offset+i < len) {
-                cd.setValue((uint8_t)(*document())[offset+i]);
-            } else {
-                cd.setValue(' ');
-            }
+    int x = 0;
+    for(int i = 0; i < cols; i++) {
+        uint8_t byte = i < bytes.size() ? bytes[i] : 0;
+        int fg = parent()->textFg(i&1)[byte];
+        HexCellDesc cd;
 
-            if(offset+i == cursor()->position() && parent()->isEditable()) {
-                if(!haveFocus || mCursorFlash) cd.enableFrame(true);
-                else cd.setFgBg(parent()->cursorFg(), parent()->cursorBg());
-            }
+        if(selStart <= offset+i && offset+i < selEnd)
+            cd.setFgBg(HexWidgetPrivate::SelFg, HexWidgetPrivate::SelBg);
+        else
+            cd.setFgBg(fg, bg);
 
-            painter.drawPixmap(x, y, parent()->fetchCell(cd));
-            x += charWidth();
+        if(i < bytes.size()) {
+            cd.setValue(byte);
+        } else {
+            cd.setValue(' ');
         }
-        while(x < width()) {
-            painter.drawPixmap(x, y, parent()->fetchCell(HexCellDesc(' ', QColor(), bg)));
-            x += charWidth();
+
+        if(offset+i == cursor()->position() && cursorLook) {
+            if(cursorLook == 1) cd.enableFrame(true);
+            else cd.setFgBg(HexWidgetPrivate::CursorFg, HexWidgetPrivate::CursorBg);
         }
-        y += parent()->charHeight();
+
+        addCell(x, 0, cd);
+        x += charWidth();
     }
+    drawCells(painter);
 }
 
 
@@ -2858,6 +5137,469 @@ void HexTextView::mouseMoveEvent(QMouseEvent *e) {
 }
 
 
+#include <math.h>
+
+static HexStatsChunk computeStats(HexStatsChunk chunk, QByteArray data, int blockSize) {
+    const uint8_t *p = (const uint8_t*)data.constData();
+    int count = (data.size()+blockSize-1)/blockSize;
+    chunk.blocks.resize(count);
+
+    for(int b = 0; b < count; b++) {
+        int n = qMin(blockSize, data.size()-b*blockSize);
+        int hist[256];
+        memset(hist, 0, sizeof(hist));
+        for(int i = 0; i < n; i++)
+            hist[p[i]]++;
+        p += n;
+
+        // entropy in bits per byte: log2(n) - sum(c*log2(c))/n
+        double sum = 0;
+        int ascii = hist['\t'] + hist['\n'] + hist['\r'];
+        for(int i = 0; i < 256; i++) {
+            if(hist[i] > 1) sum += hist[i]*log((double)hist[i]);
+            if(i >= 0x20 && i < 0x7f) ascii += hist[i];
+        }
+        double entropy = (log((double)n) - sum/n)/log(2.0);
+
+        HexBlockStats &st = chunk.blocks[b];
+        st.entropy = (uint8_t)qBound(0, (int)(entropy*255/8+0.5), 255);
+        st.zeros = (uint8_t)(hist[0x00]*255/n);
+        st.ones = (uint8_t)(hist[0xff]*255/n);
+        st.ascii = (uint8_t)(ascii*255/n);
+        st.valid = true;
+    }
+    return chunk;
+}
+
+
+HexOverview::HexOverview(HexDocument *doc, QObject *parent)
+    : QObject(parent)
+{
+    mDocument = doc;
+    mSerial = 0;
+    mShifted = -1;
+    mRescanTimer.setSingleShot(true);
+    mRescanTimer.setInterval(RescanDelay);
+    connect(&mRescanTimer, SIGNAL(timeout()), this, SLOT(rescanShifted()));
+    connect(doc, SIGNAL(rangeChanged(OffType, OffType, OffType)),
+            this, SLOT(documentChanged(OffType, OffType, OffType)));
+    reset();
+}
+
+HexOverview::~HexOverview() {
+    foreach(QFutureWatcher<HexStatsChunk> *job, mJobs.keys()) {
+        job->waitForFinished();
+        delete job;
+    }
+}
+
+void HexOverview::reset() {
+    OffType length = mDocument->length();
+    mBlockSize = MinBlockSize;
+    while(length/mBlockSize > TargetBlocks)
+        mBlockSize *= 2;
+
+    qint64 count = qMax((OffType)1, (length+mBlockSize-1)/mBlockSize);
+    mLevels.clear();
+    for(;;) {
+        mLevels.append(QVector<HexBlockStats>(count));
+        if(count == 1) break;
+        count = (count+1)/2;
+    }
+
+    addEdit(0, LLONG_MAX); // block size may differ, nothing read before fits
+    mShifted = -1;
+    mRescanTimer.stop();
+    mPending.clear();
+    mPending.append(qMakePair((qint64)0, (qint64)mLevels[0].size()));
+    startJobs();
+}
+
+int HexOverview::levelFor(OffType size) const {
+    int level = 0;
+    while(level+1 < levels() && mBlockSize<<(level+1) <= size)
+        level++;
+    return level;
+}
+
+HexBlockStats HexOverview::stats(int level, OffType offset) const {
+    const QVector<HexBlockStats> &blocks = mLevels[level];
+    qint64 index = offset/(mBlockSize<<level);
+    if(index < 0 || index >= blocks.size()) return HexBlockStats();
+    return blocks[index];
+}
+
+void HexOverview::documentChanged(OffType start, OffType end, OffType delta) {
+    OffType length = mDocument->length();
+    if(length/mBlockSize > 4*TargetBlocks) {
+        reset(); // blocks got too small for this size
+        return;
+    }
+
+    qint64 first = start/mBlockSize;
+    if(!delta) {
+        qint64 last = (end+mBlockSize-1)/mBlockSize;
+        addEdit(first, last);
+        invalidate(first, last);
+        startJobs();
+        return;
+    }
+
+    // everything after start moved, block count may change too
+    addEdit(first, LLONG_MAX);
+    qint64 count = qMax((OffType)1, (length+mBlockSize-1)/mBlockSize);
+    for(int level = 0; level < levels(); level++) {
+        mLevels[level].resize(count);
+        count = (count+1)/2;
+    }
+    while(count > 1) {
+        mLevels.append(QVector<HexBlockStats>(count));
+        count = (count+1)/2;
+    }
+
+    // blocks with new bytes are redone now, moved ones keep their old
+    // stats as approximation till edits pause, so typing in insert mode
+    // doesn't rescan the rest of document on every key
+    invalidate(first, (start+qMax(delta, (OffType)1)+mBlockSize-1)/mBlockSize);
+    if(mShifted < 0 || first < mShifted) mShifted = first;
+    mRescanTimer.start();
+    startJobs();
+}
+
+void HexOverview::rescanShifted() {
+    if(mShifted < 0) return;
+    queue(mShifted, mLevels[0].size());
+    mShifted = -1;
+    startJobs();
+}
+
+// results of jobs running now are stale in blocks [first, last)
+void HexOverview::addEdit(qint64 first, qint64 last) {
+    mSerial++;
+    if(mJobs.isEmpty()) return;
+    Edit edit = {mSerial, first, last};
+    mEdits.append(edit);
+}
+
+// marks blocks [first, last) and their parents unknown and queues them
+void HexOverview::invalidate(qint64 first, qint64 last) {
+    last = qMin(last, (qint64)mLevels[0].size());
+    if(first >= last) return;
+
+    for(int level = 0; level < levels(); level++) {
+        for(qint64 i = first>>level; i <= (last-1)>>level; i++)
+            mLevels[level][i].valid = false;
+    }
+    queue(first, last);
+}
+
+// queues blocks [first, last), dropping them from ranges queued before
+void HexOverview::queue(qint64 first, qint64 last) {
+    qint64 size = mLevels[0].size();
+    last = qMin(last, size);
+    if(first >= last) return;
+
+    QList<QPair<qint64, qint64> > pending;
+    for(int i = 0; i < mPending.size(); i++) {
+        qint64 from = mPending[i].first;
+        qint64 to = qMin(mPending[i].second, size);
+        if(from < qMin(to, first)) pending.append(qMakePair(from, qMin(to, first)));
+        if(qMax(from, last) < to) pending.append(qMakePair(qMax(from, last), to));
+    }
+    pending.append(qMakePair(first, last));
+    mPending = pending;
+}
+
+void HexOverview::startJobs() {
+    int blocksPerJob = (int)qMax((OffType)1, ChunkSize/mBlockSize);
+    OffType length = mDocument->length();
+
+    int maxJobs = qMax(1, QThread::idealThreadCount());
+    while(mJobs.size() < maxJobs && !mPending.isEmpty()) {
+        QPair<qint64, qint64> &range = mPending.first();
+        HexStatsChunk chunk;
+        chunk.first = range.first;
+        chunk.serial = mSerial;
+        qint64 last = qMin(range.second, range.first+blocksPerJob);
+        range.first = last;
+        if(range.first >= range.second) mPending.removeFirst();
+
+        OffType start = chunk.first*mBlockSize;
+        QByteArray data = mDocument->read(start, qMin(length, last*mBlockSize));
+        if(data.isEmpty()) continue;
+
+        QFutureWatcher<HexStatsChunk> *job = new QFutureWatcher<HexStatsChunk>(this);
+        connect(job, SIGNAL(finished()), this, SLOT(jobDone()));
+        job->setFuture(QtConcurrent::run(computeStats, chunk, data, (int)mBlockSize));
+        mJobs.insert(job, mSerial);
+    }
+}
+
+void HexOverview::jobDone() {
+    QFutureWatcher<HexStatsChunk> *job = (QFutureWatcher<HexStatsChunk> *)sender();
+    mJobs.remove(job);
+    HexStatsChunk chunk = job->result();
+    job->deleteLater();
+
+    // blocks edited after data was read are dropped, the edit queued
+    // them again or left them to rescan of moved blocks
+    qint64 last = chunk.first+chunk.blocks.size();
+    foreach(const Edit &edit, mEdits) {
+        if(edit.serial <= chunk.serial) continue;
+        for(qint64 i = qMax(edit.first, chunk.first); i < qMin(edit.last, last); i++)
+            chunk.blocks[i-chunk.first].valid = false;
+    }
+    store(chunk);
+    emit updated();
+
+    // edits older than every running job can't make results stale
+    int oldest = mSerial;
+    foreach(int serial, mJobs)
+        oldest = qMin(oldest, serial);
+    while(!mEdits.isEmpty() && mEdits.first().serial <= oldest)
+        mEdits.removeFirst();
+    startJobs();
+}
+
+// puts level 0 blocks and updates their parents
+void HexOverview::store(const HexStatsChunk &chunk) {
+    qint64 first = chunk.first;
+    qint64 last = qMin(first+chunk.blocks.size(), (qint64)mLevels[0].size());
+    for(qint64 i = first; i < last; i++) {
+        if(chunk.blocks[i-first].valid) mLevels[0][i] = chunk.blocks[i-first];
+    }
+
+    for(int level = 1; level < levels() && first < last; level++) {
+        first >>= 1;
+        last = (last+1) >> 1;
+        const QVector<HexBlockStats> &below = mLevels[level-1];
+        for(qint64 i = first; i < last; i++) {
+            const HexBlockStats &a = below[2*i];
+            HexBlockStats b = 2*i+1 < below.size() ? below[2*i+1] : a;
+            HexBlockStats &st = mLevels[level][i];
+            // averaged entropy is only an estimate, good enough for a picture
+            st.valid = a.valid && b.valid;
+            st.entropy = (a.entropy+b.entropy)/2;
+            st.zeros = (a.zeros+b.zeros)/2;
+            st.ones = (a.ones+b.ones)/2;
+            st.ascii = (a.ascii+b.ascii)/2;
+        }
+    }
+}
+
+
+HexMinimap::HexMinimap(HexWidgetPrivate *parent)
+    : QWidget(parent)
+{
+    mParent = parent;
+    mZoom = 1;
+    mOverview = parent->document()->overview();
+    connect(mOverview, SIGNAL(updated()), this, SLOT(overviewUpdated()));
+    connect(parent->cursor(), SIGNAL(topChanged()), this, SLOT(update()));
+    setSizePolicy(QSizePolicy(QSizePolicy::Fixed, QSizePolicy::Expanding));
+    setAttribute(Qt::WA_OpaquePaintEvent);
+    setCursor(Qt::PointingHandCursor);
+}
+
+void HexMinimap::overviewUpdated() {
+    HexRepaintScheduler::instance()->update(this, rect());
+}
+
+QSize HexMinimap::sizeHint() const {
+    return QSize(3*StripeWidth, 32);
+}
+
+OffType HexMinimap::windowLength() {
+    return qMax((OffType)1, mParent->document()->length()/mZoom);
+}
+
+OffType HexMinimap::windowStart() {
+    OffType length = mParent->document()->length();
+    OffType window = windowLength();
+    OffType start = mParent->cursor()->top() - window/2;
+    return qBound((OffType)0, start, qMax((OffType)0, length-window));
+}
+
+OffType HexMinimap::offsetAt(int y) {
+    y = qBound(0, y, qMax(0, height()-1));
+    return windowStart() + (OffType)((double)windowLength()*y/qMax(1, height()));
+}
+
+void HexMinimap::paintEvent(QPaintEvent *event) {
+    QImage image(3*StripeWidth, qMax(1, height()), QImage::Format_RGB32);
+    OffType start = windowStart();
+    OffType window = windowLength();
+    int level = mOverview->levelFor(window/qMax(1, height()));
+    QRgb unknown = palette().color(QPalette::Mid).rgb();
+
+    for(int y = 0; y < image.height(); y++) {
+        HexBlockStats st = mOverview->stats(level, start + (OffType)((double)window*y/image.height()));
+        QRgb entropy = unknown, fill = unknown, ascii = unknown;
+        if(st.valid) {
+            // blue for constant data up to red for random one
+            entropy = QColor::fromHsv(240*(255-st.entropy)/255, 255, 255).rgb();
+            int gray = 128 + (st.ones - st.zeros)/2;
+            fill = qRgb(gray, gray, gray);
+            ascii = qRgb(0, st.ascii, 0);
+        }
+        QRgb *line = (QRgb*)image.scanLine(y);
+        for(int x = 0; x < StripeWidth; x++) {
+            line[x] = entropy;
+            line[StripeWidth+x] = fill;
+            line[2*StripeWidth+x] = ascii;
+        }
+    }
+
+    QPainter painter(this);
+    painter.drawImage(0, 0, image);
+    if(width() > image.width())
+        painter.fillRect(image.width(), 0, width()-image.width(), height(), palette().window());
+
+    // part shown by views
+    int rows = height()/qMax(1, mParent->charHeight());
+    OffType top = mParent->cursor()->top();
+    OffType bottom = top + (OffType)rows*mParent->cols();
+    int y0 = (int)((double)(top-start)*height()/window);
+    int y1 = (int)((double)(bottom-start)*height()/window);
+    painter.setPen(palette().color(QPalette::Highlight));
+    painter.setBrush(Qt::NoBrush);
+    painter.drawRect(0, y0, width()-1, qMax(1, y1-y0));
+}
+
+void HexMinimap::moveTo(int y) {
+    // clicked offset goes to the middle of view
+    int rows = height()/qMax(1, mParent->charHeight());
+    OffType offset = offsetAt(y) - (OffType)rows/2*mParent->cols();
+    mParent->cursor()->setTop(qMax((OffType)0, offset));
+}
+
+void HexMinimap::mousePressEvent(QMouseEvent *e) {
+    if(e->button() & Qt::LeftButton) {
+        moveTo(e->pos().y());
+        e->accept();
+    } else {
+        QWidget::mousePressEvent(e);
+    }
+}
+
+void HexMinimap::mouseMoveEvent(QMouseEvent *e) {
+    if(e->buttons() & Qt::LeftButton) {
+        moveTo(e->pos().y());
+        e->accept();
+    } else {
+        QWidget::mouseMoveEvent(e);
+    }
+}
+
+void HexMinimap::wheelEvent(QWheelEvent *e) {
+    if(!(e->modifiers() & Qt::ControlModifier)) {
+        QWidget::wheelEvent(e);
+        return;
+    }
+
+    // pyramid levels make every zoom instant
+    if(e->delta() > 0) mZoom = qMin(mZoom*2, 1 << 20);
+    else mZoom = qMax(mZoom/2, 1);
+    update();
+    e->accept();
+}
+
+
+HexRepaintScheduler *HexRepaintScheduler::mInstance = 0;
+
+HexRepaintScheduler *HexRepaintScheduler::instance() {
+    if(!mInstance) mInstance = new HexRepaintScheduler(qApp);
+    return mInstance;
+}
+
+HexRepaintScheduler::HexRepaintScheduler(QObject *parent)
+    : QObject(parent)
+{
+    mTimer.setSingleShot(true);
+    connect(&mTimer, SIGNAL(timeout()), this, SLOT(frame()));
+    connect(HexSettings::instance(), SIGNAL(changed()), this, SLOT(readSettings()));
+    readSettings();
+    mLastFrame.start();
+}
+
+void HexRepaintScheduler::readSettings() {
+    QSettings settings;
+    settings.beginGroup("HexWidget");
+    LOAD_INT(mFrameRate, HexSettings::defFrameRate());
+    settings.endGroup();
+    mFrameRate = qMax(1, mFrameRate);
+}
+
+void HexRepaintScheduler::update(QWidget *widget, const QRect &rect) {
+    for(int i = 0; i < mRepaints.size(); i++) {
+        if(mRepaints[i].widget == widget) {
+            mRepaints[i].region += rect;
+            mStats.coalescedRequests++;
+            return;
+        }
+    }
+
+    Repaint repaint;
+    repaint.widget = widget;
+    repaint.region = rect;
+    mRepaints.append(repaint);
+    schedule();
+}
+
+void HexRepaintScheduler::scroll(QWidget *widget, int dx, int dy) {
+    for(int i = 0; i < mRepaints.size(); i++) {
+        if(mRepaints[i].widget == widget) {
+            mRepaints[i].region.translate(dx, dy);
+            mRepaints[i].region &= widget->rect();
+        }
+    }
+}
+
+void HexRepaintScheduler::call(QObject *receiver, const char *member) {
+    foreach(const Call &c, mCalls) {
+        if(c.receiver == receiver && c.member == member) {
+            mStats.coalescedRequests++;
+            return;
+        }
+    }
+
+    Call c;
+    c.receiver = receiver;
+    c.member = member;
+    mCalls.append(c);
+    schedule();
+}
+
+// next frame comes no sooner than 1/frameRate after previous one
+void HexRepaintScheduler::schedule() {
+    if(mTimer.isActive()) return;
+    qint64 interval = 1000/mFrameRate;
+    mTimer.start((int)qMax((qint64)0, interval - mLastFrame.elapsed()));
+}
+
+void HexRepaintScheduler::frame() {
+    QList<Repaint> repaints = mRepaints;
+    QList<Call> calls = mCalls;
+    mRepaints.clear();
+    mCalls.clear();
+
+    // repaint synchronously, so frame time includes painting
+    QElapsedTimer timer;
+    timer.start();
+    foreach(const Call &c, calls)
+        if(c.receiver) QMetaObject::invokeMethod(c.receiver, c.member.constData());
+    foreach(const Repaint &r, repaints)
+        if(r.widget && r.widget->isVisible()) r.widget->repaint(r.region);
+    qint64 nsecs = timer.nsecsElapsed();
+
+    mStats.frames++;
+    mStats.lastFrameNsecs = nsecs;
+    mStats.maxFrameNsecs = qMax(mStats.maxFrameNsecs, nsecs);
+    mStats.totalFrameNsecs += nsecs;
+    mLastFrame.restart();
+}
+
+
 #undef q
 #undef d
 
@@ -3139,6 +5881,11 @@ HexSettingsPanel::HexSettingsPanel(QWidget *parent)
     mColors.append(ColorSetup(tr("selection background"), &mSelBg));
     mColors.append(ColorSetup(tr("cursor foreground"), &mCursorFg));
     mColors.append(ColorSetup(tr("cursor background"), &mCursorBg));
+    mColors.append(ColorSetup(tr("zero byte foreground"), &mZeroFg));
+    mColors.append(ColorSetup(tr("0xFF byte foreground"), &mFullFg));
+    mColors.append(ColorSetup(tr("printable byte foreground"), &mPrintableFg));
+    mColors.append(ColorSetup(tr("control byte foreground"), &mControlFg));
+    mColors.append(ColorSetup(tr("high byte foreground"), &mHighFg));
 
     mColorBox = new QComboBox(this);
     connect(mColorBox, SIGNAL(currentIndexChanged(int)), this, SLOT(indexChanged(int)));
@@ -3179,6 +5926,79 @@ HexSettingsPanel::HexSettingsPanel(QWidget *parent)
     grpColsLay->addWidget(grpColsLabel);
     grpColsLay->addWidget(grpColsSpin);
 
+    QLabel *cacheLabel = new QLabel(tr("Cache per document (KiB): "), this);
+    QSpinBox *cacheSpin = new QSpinBox(this);
+    cacheSpin->setRange(1, 64*1024*1024);
+    cacheSpin->setValue(mCacheSize);
+    cacheSpin->setKeyboardTracking(false); // every change flushes caches
+    connect(cacheSpin, SIGNAL(valueChanged(int)), this, SLOT(setCacheSize(int)));
+    QHBoxLayout *cacheLay = new QHBoxLayout;
+    cacheLay->addWidget(cacheLabel);
+    cacheLay->addWidget(cacheSpin);
+
+    QLabel *pageLabel = new QLabel(tr("Cache page size (0 - auto): "), this);
+    QSpinBox *pageSpin = new QSpinBox(this);
+    pageSpin->setRange(0, 16*1024*1024);
+    pageSpin->setSingleStep(HexSettings::minCachePageSize());
+    pageSpin->setValue(mCachePageSize);
+    pageSpin->setKeyboardTracking(false);
+    connect(pageSpin, SIGNAL(valueChanged(int)), this, SLOT(setCachePageSize(int)));
+    QHBoxLayout *pageLay = new QHBoxLayout;
+    pageLay->addWidget(pageLabel);
+    pageLay->addWidget(pageSpin);
+
+    QLabel *budgetLabel = new QLabel(tr("Total cache budget (MiB, 0 - unlimited): "), this);
+    QSpinBox *budgetSpin = new QSpinBox(this);
+    budgetSpin->setRange(0, 1024*1024);
+    budgetSpin->setValue(mCacheBudget);
+    budgetSpin->setKeyboardTracking(false);
+    connect(budgetSpin, SIGNAL(valueChanged(int)), this, SLOT(setCacheBudget(int)));
+    QHBoxLayout *budgetLay = new QHBoxLayout;
+    budgetLay->addWidget(budgetLabel);
+    budgetLay->addWidget(budgetSpin);
+
+    QLabel *undoLabel = new QLabel(tr("Undo memory (MiB, 0 - unlimited): "), this);
+    QSpinBox *undoSpin = new QSpinBox(this);
+    undoSpin->setRange(0, 1024*1024);
+    undoSpin->setValue(mUndoMemory);
+    undoSpin->setKeyboardTracking(false); // partial values would spill undo data
+    connect(undoSpin, SIGNAL(valueChanged(int)), this, SLOT(setUndoMemory(int)));
+    QHBoxLayout *undoLay = new QHBoxLayout;
+    undoLay->addWidget(undoLabel);
+    undoLay->addWidget(undoSpin);
+
+    QLabel *textFormatLabel = new QLabel(tr("Copy as text format: "), this);
+    QComboBox *textFormatBox = new QComboBox(this);
+    textFormatBox->addItems(HexTextEncoder::formatNames());
+    textFormatBox->setCurrentIndex(mTextFormat);
+    connect(textFormatBox, SIGNAL(currentIndexChanged(int)), this, SLOT(setTextFormat(int)));
+    QHBoxLayout *textFormatLay = new QHBoxLayout;
+    textFormatLay->addWidget(textFormatLabel);
+    textFormatLay->addWidget(textFormatBox);
+
+    QLabel *frameRateLabel = new QLabel(tr("Max frame rate on data changes (fps): "), this);
+    QSpinBox *frameRateSpin = new QSpinBox(this);
+    frameRateSpin->setRange(1, 240);
+    frameRateSpin->setValue(mFrameRate);
+    connect(frameRateSpin, SIGNAL(valueChanged(int)), this, SLOT(setFrameRate(int)));
+    QHBoxLayout *frameRateLay = new QHBoxLayout;
+    frameRateLay->addWidget(frameRateLabel);
+    frameRateLay->addWidget(frameRateSpin);
+
+    QLabel *renderModeLabel = new QLabel(tr("Renderer: "), this);
+    QComboBox *renderModeBox = new QComboBox(this);
+    renderModeBox->addItem(tr("QPainter with glyph atlas"));
+    renderModeBox->addItem(tr("Direct scanline copy"));
+    renderModeBox->setCurrentIndex(mRenderMode);
+    connect(renderModeBox, SIGNAL(currentIndexChanged(int)), this, SLOT(setRenderMode(int)));
+    QHBoxLayout *renderModeLay = new QHBoxLayout;
+    renderModeLay->addWidget(renderModeLabel);
+    renderModeLay->addWidget(renderModeBox);
+
+    QCheckBox *byteClassesBox = new QCheckBox(tr("Color bytes by class (zero, 0xFF, printable, control, high)"), this);
+    byteClassesBox->setChecked(mByteClasses);
+    connect(byteClassesBox, SIGNAL(toggled(bool)), this, SLOT(setByteClasses(bool)));
+
     //QPushButton *applyButton = new QPushButton(tr("&Apply"), this);
     //connect(applyButton, SIGNAL(clicked()), this, SLOT(apply()));
     QPushButton *doneButton = new QPushButton(tr("&Done"), this);
@@ -3191,6 +6011,14 @@ HexSettingsPanel::HexSettingsPanel(QWidget *parent)
     QVBoxLayout *mainLay = new QVBoxLayout;
     mainLay->addLayout(colsLay);
     mainLay->addLayout(grpColsLay);
+    mainLay->addLayout(cacheLay);
+    mainLay->addLayout(pageLay);
+    mainLay->addLayout(budgetLay);
+    mainLay->addLayout(undoLay);
+    mainLay->addLayout(textFormatLay);
+    mainLay->addLayout(frameRateLay);
+    mainLay->addLayout(renderModeLay);
+    mainLay->addWidget(byteClassesBox);
     mainLay->addLayout(fontLay);
     mainLay->addLayout(colorLay);
     mainLay->addLayout(buttonLay);
@@ -3210,6 +6038,9 @@ void HexSettingsPanel::readSettings() {
 
     LOAD_INT(mCols, HexSettings::defCols());
     LOAD_INT(mGroupCols, HexSettings::defGroupCols());
+    LOAD_INT(mFrameRate, HexSettings::defFrameRate());
+    LOAD_INT(mRenderMode, HexSettings::defRenderMode());
+    LOAD_INT(mByteClasses, HexSettings::defByteClasses());
 
     LOAD_COLOR(mOffsetFg,	HexSettings::defOffsetFg());
     LOAD_COLOR(mOffsetBg,	HexSettings::defOffsetBg());
@@ -3225,7 +6056,20 @@ void HexSettingsPanel::readSettings() {
     LOAD_COLOR(mSelBg,		HexSettings::defSelBg());
     LOAD_COLOR(mCursorFg,	HexSettings::defCursorFg());
     LOAD_COLOR(mCursorBg,	HexSettings::defCursorBg());
+    LOAD_COLOR(mZeroFg,		HexSettings::defZeroFg());
+    LOAD_COLOR(mFullFg,		HexSettings::defFullFg());
+    LOAD_COLOR(mPrintableFg,	HexSettings::defPrintableFg());
+    LOAD_COLOR(mControlFg,	HexSettings::defControlFg());
+    LOAD_COLOR(mHighFg,		HexSettings::defHighFg());
+
+    settings.endGroup();
 
+    settings.beginGroup("HexDocument");
+    LOAD_INT(mCacheSize, HexSettings::defCacheSize());
+    LOAD_INT(mCachePageSize, HexSettings::defCachePageSize());
+    LOAD_INT(mCacheBudget, HexSettings::defCacheBudget());
+    LOAD_INT(mUndoMemory, HexSettings::defUndoMemory());
+    LOAD_INT(mTextFormat, HexSettings::defTextFormat());
     settings.endGroup();
 }
 
@@ -3236,6 +6080,9 @@ void HexSettingsPanel::apply() {
     SAVE(mFont);
     SAVE(mCols);
     SAVE(mGroupCols);
+    SAVE(mFrameRate);
+    SAVE(mRenderMode);
+    SAVE(mByteClasses);
 
     SAVE(mOffsetFg);
     SAVE(mOffsetBg);
@@ -3251,6 +6098,19 @@ void HexSettingsPanel::apply() {
     SAVE(mSelBg);
     SAVE(mCursorFg);
     SAVE(mCursorBg);
+    SAVE(mZeroFg);
+    SAVE(mFullFg);
+    SAVE(mPrintableFg);
+    SAVE(mControlFg);
+    SAVE(mHighFg);
+    settings.endGroup();
+
+    settings.beginGroup("HexDocument");
+    SAVE(mCacheSize);
+    SAVE(mCachePageSize);
+    SAVE(mCacheBudget);
+    SAVE(mUndoMemory);
+    SAVE(mTextFormat);
     settings.endGroup();
 
     HexSettings::instance()->emitChanged();
@@ -3271,6 +6131,63 @@ void HexSettingsPanel::setGroupCols(int groupCols) {
     }
 }
 
+void HexSettingsPanel::setCacheSize(int cacheSize) {
+    if(cacheSize != mCacheSize) {
+        mCacheSize = cacheSize;
+        apply();
+    }
+}
+
+void HexSettingsPanel::setCachePageSize(int pageSize) {
+    if(pageSize > 0) pageSize = qMax(pageSize, HexSettings::minCachePageSize());
+    if(pageSize != mCachePageSize) {
+        mCachePageSize = pageSize;
+        apply();
+    }
+}
+
+void HexSettingsPanel::setCacheBudget(int budget) {
+    if(budget != mCacheBudget) {
+        mCacheBudget = budget;
+        apply();
+    }
+}
+
+void HexSettingsPanel::setUndoMemory(int undoMemory) {
+    if(undoMemory != mUndoMemory) {
+        mUndoMemory = undoMemory;
+        apply();
+    }
+}
+
+void HexSettingsPanel::setTextFormat(int textFormat) {
+    if(textFormat != mTextFormat) {
+        mTextFormat = textFormat;
+        apply();
+    }
+}
+
+void HexSettingsPanel::setFrameRate(int frameRate) {
+    if(frameRate != mFrameRate) {
+        mFrameRate = frameRate;
+        apply();
+    }
+}
+
+void HexSettingsPanel::setRenderMode(int renderMode) {
+    if(renderMode != mRenderMode) {
+        mRenderMode = renderMode;
+        apply();
+    }
+}
+
+void HexSettingsPanel::setByteClasses(bool state) {
+    if(state != (bool)mByteClasses) {
+        mByteClasses = state;
+        apply();
+    }
+}
+
 void HexSettingsPanel::indexChanged(int index) {
     mColorPicker->setColor(*mColors.at(index).color);
 }
@@ -3894,6 +6811,7 @@ HexEdImpl::~HexEdImpl() {
 }
 
 int HexEdImpl::exec() {
+    HexWidgetPrivate::prewarmGlyphs(); // ready by the time first file is opened
     loadPlugins();
     mainWindow->loadSettings();
     mainWindow->show();
@@ -3952,6 +6870,8 @@ void HexEdImpl::updateStatus(QString status) {
     mainWindow->updateStatus(status);
 }
 
+
+#ifndef HEX_BENCHMARK // benchmark/benchmark.pro has its own main()
 int main(int argc, char *argv[]) {
     Q_INIT_RESOURCE(resources);
 
@@ -3969,4 +6889,4 @@ int main(int argc, char *argv[]) {
 
     return HexEdImpl(argc, argv).exec();
 }
-
+#endif
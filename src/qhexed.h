@@ -32,9 +32,16 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
+#include <limits.h>
 #include <assert.h>
 #include <QtGui>
 #include <QFile>
+#include <QFutureWatcher>
+#include <QtConcurrentRun>
+#if QT_VERSION >= 0x050000
+#include <QStandardPaths>
+#include <QLockFile>
+#endif
 
 
 
@@ -125,6 +132,8 @@ public slots:
     void copyAsText();
     void paste();
     void pasteOver();
+    void pasteHex();
+    void pasteHexOver();
     void selectAll();
     void clearSelection();
     void undo();
@@ -135,7 +144,7 @@ signals:
     void topChanged();
 
 private slots:
-    void documentChanged();
+    void documentChanged(OffType start, OffType end, OffType delta);
 
 private:
     HexDocument *mDocument;
@@ -268,6 +277,27 @@ public:
     virtual void paste(OffType where, const QByteArray &what) {
     }
 
+    // models keeping data in immutable chunks (see hasSharedPieces) return
+    // them without copying, so undo can reference data instead of duplicating
+    // it; pieces start at start, the last one may be a copy of at most
+    // maxCopy bytes and its size is added to copied
+    virtual QList<QByteArray> pieces(OffType start, OffType end, int maxCopy, qint64 &copied) {
+        QByteArray piece = copy(start, qMin(end, start+maxCopy));
+        copied += piece.size();
+        return QList<QByteArray>() << piece;
+    }
+
+    virtual void pastePieces(OffType where, const QList<QByteArray> &pieces) {
+        foreach(const QByteArray &piece, pieces) {
+            paste(where, piece);
+            where += piece.size();
+        }
+    }
+
+    virtual bool hasSharedPieces() {
+        return false;
+    }
+
     void pasteOver(OffType where, const QByteArray &what) {
         write(where, what.data(), what.size());
     }
@@ -287,7 +317,7 @@ class HexCache {
 public:
     class Reference {
     public:
-        Reference(HexCache &inHexCache, int inOffset)
+        Reference(HexCache &inHexCache, OffType inOffset)
            : cache(inHexCache), offset(inOffset) {
         }
 
@@ -310,19 +340,43 @@ public:
 
     private:
         HexCache &cache;
-        int offset;
+        OffType offset;
+    };
+
+    enum {
+        MaxDirty = 4 // max number of dirty intervals tracked per page
+    };
+
+    struct Interval {
+        int start, end;	// [start, end) in page relative bytes
     };
 
     struct Page {
         Page *prev, *next;
         OffType offset; // line offset and hash key
-        OffType modified;	// number of bytes modified or -1 if page isn't modified
-        // note: alternatively we can implement range by using startOfModified, but this will
-        //       complicate code, without any perfomance increasion in general case
+        int numDirty;	// number of modified intervals, 0 if page isn't modified
+        // note: slow backends (ptrace, nfs, devices) pay for every written byte,
+        //       so we keep a few sorted intervals and write back only them
+        Interval dirty[MaxDirty+1]; // one spare slot used while merging
         uint8_t *data;
     };
 
-    HexCache(HexDataModel &inDsm, int cacheSize=100*1024, int inPageSize=-1);
+    struct Stats {
+        Stats() : lookups(0), misses(0), writes(0), bytesDirtied(0), bytesWritten(0) {}
+
+        // bytes written to data model per byte actually modified
+        double writeAmplification() const {
+            return bytesDirtied ? (double)bytesWritten/bytesDirtied : 1.0;
+        }
+
+        qint64 lookups;			// page lookups
+        qint64 misses;			// lookups that had to read data model
+        qint64 writes;			// write calls issued to data model
+        qint64 bytesDirtied;	// distinct bytes modified between flushes
+        qint64 bytesWritten;	// bytes written to data model
+    };
+
+    HexCache(HexDataModel &inDsm, OffType cacheSize=100*1024, int inPageSize=-1);
     ~HexCache();
 
     inline Reference operator[](OffType offset) {
@@ -330,43 +384,96 @@ public:
     }
 
     void prefetch(OffType offset) {
-        fetchDeep(offset/pageSize);
+        fetchDeep(offset/mPageSize);
     }
 
     void refetch() {
-        for(int i = 0; i < numPages; i++)
-            if(pages[i].offset != (OffType)-1) {
-                dsm.read(pages[i].data, pages[i].offset, pageSize);
-                pages[i].modified = -1;
+        for(Page *page = leastRecentlyUsed; page; page = page->next)
+            if(page->offset != (OffType)-1) {
+                dsm.read(page->data, page->offset*mPageSize, mPageSize);
+                page->numDirty = 0;
             }
     }
 
+    const Stats &stats() {
+        return mStats;
+    }
+
+    void resetStats() {
+        mStats = Stats();
+    }
+
+    // number of bytes this cache would like to use; actual size may be lower
+    // if sum of all caches exceeds global budget
+    OffType cacheSize() {
+        return mRequestedSize;
+    }
+
+    int pageSize() {
+        return mPageSize;
+    }
+
+    int numPages() {
+        return mNumPages;
+    }
+
+    // resizes cache in place, keeping most recently used pages
+    void setCacheSize(OffType cacheSize);
+
+    // changing page size rekeys every page, so this flushes and clears cache
+    void setPageSize(int inPageSize);
+
+    // total number of bytes shared by all caches, 0 means unlimited
+    static OffType globalBudget() {
+        return mGlobalBudget;
+    }
+
+    static void setGlobalBudget(OffType budget);
+
     // call clear() when unerlaying data model makes current cache invalid
     void clear();
     void flush();
 
+    // following two should be called on a flushed cache right after the data model
+    // was changed behind our back: remap() follows insertion (delta > 0) or removal
+    // (delta < 0) at `where` by rekeying pages after the edit, dropping only pages
+    // we can't rebuild from cached data; update() copies overwritten bytes into
+    // cached pages
+    void remap(OffType where, OffType delta);
+    void update(OffType offset, const void *src, OffType size);
+
     inline uint8_t getByte(OffType offset) {
-        return fetch(offset)->data[offset%pageSize];
+        return fetch(offset)->data[offset%mPageSize];
     }
 
     inline void putByte(OffType offset, uint8_t val) {
         Page *page = fetch(offset);
-        offset %= pageSize;
+        offset %= mPageSize;
 
         page->data[offset] = val;
-        if(page->modified < (int)offset)
-            page->modified = offset;
+
+        // fast path: byte is already inside last modified interval
+        if(page->numDirty) {
+            Interval &last = page->dirty[page->numDirty-1];
+            if(last.start <= (int)offset && (int)offset < last.end) return;
+        }
+        markDirty(page, (int)offset, (int)offset+1);
     }
 
     OffType getLength();
 
+    // copies up to size bytes at offset, stopping at data end, with one page
+    // lookup per page; returns number of bytes copied
+    int read(OffType offset, uint8_t *dst, int size);
+
     // perform simple tests to catch common implemetation errors
     static bool selfTest();
 
 private:
     Page *fetch(OffType offset) {
-        OffType pageOffset = offset / pageSize;
+        OffType pageOffset = offset / mPageSize;
         Page *page = mostRecentlyUsed;
+        mStats.lookups++;
         if(pageOffset == page->offset) return page;
         else if(pageOffset == (page = page->prev)->offset) return page;
         //else if(pageOffset == (page = page->prev)->offset) return page;
@@ -377,27 +484,200 @@ private:
     Page *fetchDeep(OffType pageOffset);
 
     void flushPage(Page *page) {
-        if(page->modified >= 0) {
-            dsm.write(page->offset*pageSize, page->data, page->modified+1);
-            page->modified = -1;
+        for(int i = 0; i < page->numDirty; i++) {
+            Interval &iv = page->dirty[i];
+            dsm.write(page->offset*mPageSize + iv.start, page->data + iv.start, iv.end-iv.start);
+            mStats.writes++;
+            mStats.bytesWritten += iv.end-iv.start;
         }
+        page->numDirty = 0;
     }
 
+    void markDirty(Page *page, int start, int end);
+    void discardPage(Page *page);
+    void resize(int newNumPages);
+    static void rebalance();
+
     HexDataModel &dsm;
     Page *mostRecentlyUsed;
     Page *leastRecentlyUsed;
-    Page *pages;
-    int pageSize;
-    int numPages;
+    int mPageSize;
+    int mNumPages;
+    OffType mRequestedSize;
+    Stats mStats;
 
     void *hashMap;
+
+    static QList<HexCache*> mInstances;
+    static OffType mGlobalBudget;
+};
+
+
+
+
+class HexUndoStore;
+
+// range of HexUndoStore holding spilled bytes, shared by copies of
+// HexUndoData and given back to store when the last of them is gone
+class HexUndoExtent : public QSharedData {
+public:
+    HexUndoExtent(HexUndoStore *store, qint64 offset, qint64 size)
+        : mStore(store), mOffset(offset), mSize(size) {
+    }
+    ~HexUndoExtent();
+
+    qint64 size() const {
+        return mSize;
+    }
+
+    QByteArray read() const;
+
+private:
+    friend class HexUndoStore;
+    HexUndoStore *mStore;
+    qint64 mOffset;		// moved by HexUndoStore::compact()
+    qint64 mSize;
 };
 
+// temporary file where undo payloads go when they don't fit into undo
+// memory limit; space of released extents is reused and the file is
+// compacted once more of it is dead than alive
+class HexUndoStore {
+public:
+    enum {
+        MinCompactSize = 16*1024*1024 // less dead space isn't worth moving data
+    };
+
+    HexUndoStore();
+
+    // deletes store once no extent references it, spilled data may be
+    // shared with clipboard or other documents' commands
+    void destroy();
+
+    qint64 size() {
+        return mSize;
+    }
+
+    // returns extent holding copy of data or 0 on error
+    HexUndoExtent *write(const char *data, qint64 size);
+
+private:
+    ~HexUndoStore();
+    friend class HexUndoExtent;
+    bool read(char *dst, qint64 offset, qint64 size);
+    void release(HexUndoExtent *extent);
+    void compact();
+
+    QTemporaryFile *mFile;
+    qint64 mSize;				// end of last extent
+    qint64 mLiveSize;			// bytes in extents
+    QMap<qint64, qint64> mFree;	// offset -> size of holes before mSize
+    QSet<HexUndoExtent*> mExtents;
+    bool mDestroyed;
+};
+
+// bytes saved by undo command: shared pieces of data model or private
+// copies, leading ones may be spilled to HexUndoStore extents
+class HexUndoData {
+public:
+    enum {
+        ChunkSize = 1024*1024 // max size of extents and of reading spilled data back
+    };
+
+    HexUndoData()
+        : mSize(0), mStoredSize(0) {
+    }
+
+    OffType size() const {
+        return mSize;
+    }
+
+    bool isEmpty() const {
+        return !mSize;
+    }
+
+    bool isSpilled() const {
+        return !mExtents.isEmpty();
+    }
+
+    qint64 memoryUsage() const {
+        return mSize - mStoredSize;
+    }
+
+    void clear();
+    void append(const QByteArray &piece);
+    void spill(HexUndoStore *store);
 
+    int chunkCount() const;
+    QByteArray chunk(int index) const;
+    QList<QByteArray> pieces() const;
+    QByteArray toByteArray() const;
+
+private:
+    QList<QExplicitlySharedDataPointer<HexUndoExtent> > mExtents; // spilled head
+    QList<QByteArray> mPieces;	// in memory tail
+    OffType mSize;
+    qint64 mStoredSize;
+};
 
 
 class QAction;
 class HexUndoCommand;
+class HexDocument;
+class HexOverview;
+
+// append only log of edits to in memory document, replayed after crash;
+// records are batched in memory, then written and synced in worker thread
+class HexJournal : public QObject {
+    Q_OBJECT
+
+public:
+    HexJournal(HexDocument *doc);
+    ~HexJournal(); // journal of cleanly closed document isn't needed
+
+    void logInsert(OffType where, const HexUndoData &what);
+    void logWrite(OffType where, const HexUndoData &what);
+    void logDelete(OffType start, OffType end);
+
+    // journals left by crashed instances
+    static QStringList staleJournals();
+    static QString describe(const QString &fileName);
+    static HexDocument *recover(const QString &fileName);
+
+public slots:
+    void flush();
+
+private:
+    enum {
+        Magic = 0x51484a31,		// "QHJ1"
+        MaxPending = 1024*1024,	// bytes kept in memory before forced flush
+        FlushInterval = 1000	// ms
+    };
+
+    struct Header {
+        QString name;
+        QString path;		// base file, empty for new buffer
+        qint64 baseSize;
+        QDateTime baseTime;
+    };
+
+    void logData(quint8 type, OffType where, const HexUndoData &what);
+    void write(const QByteArray &data, bool sync);
+    void waitForWrite();
+    static bool readHeader(QDataStream &in, Header &header);
+    static QString directory();
+
+    QFile mFile;
+#if QT_VERSION >= 0x050000
+    QLockFile *mLock;	// held while we are alive, see staleJournals()
+#endif
+    QBuffer mPending;
+    QDataStream mStream;
+    QTimer mTimer;
+    QFuture<bool> mWriting;	// write and sync in worker thread
+    bool mWritePending;		// mWriting has result to check
+    bool mFailed;
+};
 
 class HexDocument : public QObject {
     Q_OBJECT
@@ -410,7 +690,7 @@ public:
 
     class Reference {
     public:
-        Reference(HexDocument &doc, int offset)
+        Reference(HexDocument &doc, OffType offset)
            : mDoc(doc), mOffset(offset) {
         }
 
@@ -433,7 +713,7 @@ public:
 
     private:
         HexDocument &mDoc;
-        int mOffset;
+        OffType mOffset;
     };
     friend class Reference;
 
@@ -447,12 +727,17 @@ public:
     bool saveFile(const QString &fileName);
 
     void pushCommand(HexUndoCommand *cmd);
-    QByteArray copy(OffType start, OffType end);
-    QByteArray copyAsText(OffType start, OffType end);
+    void copy(OffType start, OffType end);
+    void copyAsText(OffType start, OffType end);
+    QByteArray read(OffType start, OffType end);
 
     QAction *createRedoAction();
     QAction *createUndoAction();
 
+    // document already opened from the same file, 0 if none
+    static HexDocument *openedFile(const QString &path);
+    void registerFile(const QString &path);
+
     HexCursor *cursor() {
         return mCursor;
     }
@@ -494,6 +779,22 @@ public:
         return mModel->isCuttable();
     }
 
+    // per document cache limits override global settings,
+    // cacheSize is in KiB, zero means "use global setting"
+    int cacheSizeLimit() {
+        return mCacheSize;
+    }
+
+    int cachePageSizeLimit() {
+        return mCachePageSize;
+    }
+
+    void setCacheLimits(int cacheSize, int pageSize);
+
+    HexUndoStore *undoStore();
+    // block statistics shared by all minimaps of document
+    HexOverview *overview();
+
     void setModified(bool state);
     void setPath(QString name);
     void setName(QString name);
@@ -527,19 +828,39 @@ signals:
     // signaled when there is no need to save changes anymore
     void nameChanged();
     void changed();
+    // [start, end) was modified; delta is the change in document length,
+    // when non-zero everything past start has moved
+    void rangeChanged(OffType start, OffType end, OffType delta);
     void saved();
+    // emitted before [start, end) changes, lazy copies of it should be
+    // taken now; end is document length when following bytes move
+    void aboutToModify(OffType start, OffType end);
+
+private slots:
+    void readSettings();
+    void undoIndexChanged(int index);
 
 private:
     friend class HexUndoCommand;
+    friend class HexTransformJob;
+    friend class HexJournal;
+    friend class HexMimeData;
 
     // following function are for ours and our friend's convenience
     void del(OffType start, OffType end);
-    QByteArray cut(OffType start, OffType end);
+    void cut(OffType start, OffType end, HexUndoData &data);
+    void take(OffType start, OffType end, HexUndoData &data);
+    void capture(OffType start, OffType end, HexUndoData &data, HexUndoStore *store = 0);
     void paste(OffType where, const QByteArray &what);
+    void paste(OffType where, const HexUndoData &what);
     void pasteOver(OffType where, const QByteArray &what);
-    uint8_t replaceByte(OffType where, uint8_t what);
+    void pasteOver(OffType where, const HexUndoData &what);
+    QByteArray replaceBytes(OffType where, const QByteArray &with);
+    void setModified(OffType start, OffType end, OffType delta);
 
     void initFrom(HexDataModel *model);
+    HexJournal *journal();
+    void discardJournal();
 
     int mRefs;
     QString mName;
@@ -548,11 +869,113 @@ private:
     bool mModified;			// true if content is modified and unsaved
     bool mBuffer;
     bool mFreeModel;
+    int mCacheSize;			// KiB, 0 - use HexSettings value
+    int mCachePageSize;		// bytes, 0 - use HexSettings value
     HexCache *mCache;
     HexDataModel *mModel;
     HexCursor *mCursor;
 
     class QUndoStack *mUndoStack;
+    int mUndoIndex;				// last seen index of mUndoStack
+    HexUndoStore *mUndoStore;	// created on first spill
+    HexJournal *mJournal;		// created on first edit of in memory document
+    HexOverview *mOverview;		// created for first minimap
+    int mTextFormat;			// HexTextEncoder::Format for copyAsText
+    QString mFileKey;			// key in mFiles, empty if not registered
+    static qint64 mUndoMemoryLimit; // bytes for all documents, 0 - unlimited
+    static QHash<QString, HexDocument *> mFiles; // opened files by fileKey()
+};
+
+
+// textual representations of data for "Copy As Text" and export
+class HexTextEncoder {
+public:
+    enum Format {
+        Raw,		// bytes as is
+        HexPairs,	// "de ad be ef", 16 per line
+        Xxd,		// like xxd dump
+        CArray,		// C array initializer
+        Base64
+    };
+
+    enum {
+        // chunks passed to encode() must be of this size except last one,
+        // it is multiple of 3 for base64 and of 16 for line based formats
+        ChunkSize = 3*256*1024
+    };
+
+    HexTextEncoder(Format format = HexPairs)
+        : mFormat(format) {
+    }
+
+    Format format() const {
+        return mFormat;
+    }
+
+    // largest input whose encoding still fits into QByteArray
+    int maxInputSize() const {
+        return mFormat == Raw ? INT_MAX : INT_MAX/8;
+    }
+
+    static QStringList formatNames();
+
+    QByteArray header() const;
+    QByteArray footer() const;
+    // offset is used for xxd line offsets
+    void encode(const uint8_t *src, int size, OffType offset, QByteArray &out) const;
+    QByteArray encodeAll(const QByteArray &data, OffType offset = 0) const;
+
+    // writes 2*size hex digits to dst
+    static void hexEncode(const uint8_t *src, int size, char *dst, bool upperCase=false);
+
+    // decodes digit pairs separated by whitespace or colons, returns -1
+    // on success or offset of first invalid character
+    static qint64 decodeHex(const char *src, qint64 size, QByteArray &out);
+
+    static char digit(int nibble, bool upperCase=true) {
+        return mDigits[upperCase][nibble];
+    }
+
+private:
+    Format mFormat;
+    static const char mDigits[2][17];
+};
+
+// clipboard data rendered only when somebody asks for it. Pieces of in
+// memory models are shared right away, other ranges are read on request
+// or before document changes
+class HexMimeData : public QMimeData {
+    Q_OBJECT
+
+public:
+    HexMimeData(HexDocument *doc, OffType start, OffType end, const QString &format,
+                HexTextEncoder::Format encoding = HexTextEncoder::Raw);
+    HexMimeData(const HexUndoData &data, const QString &format);
+    ~HexMimeData();
+
+    QStringList formats() const;
+    bool hasFormat(const QString &mimeType) const;
+
+    // zero copy access for pasting inside qhexed
+    HexUndoData pieces() const;
+
+protected:
+    QVariant retrieveData(const QString &mimeType, QVariant::Type type) const;
+
+private slots:
+    void snapshot(OffType start, OffType end);
+
+private:
+    void snapshot();
+
+    QPointer<HexDocument> mDocument;
+    OffType mStart;
+    OffType mEnd;
+    QString mFormat;
+    HexTextEncoder mEncoder;
+    HexUndoData mData;
+    HexUndoStore *mStore;	// for copies of ranges of non shared models
+    bool mHaveData;
 };
 
 
@@ -772,6 +1195,9 @@ public:
     void del(OffType start, OffType end);
     void paste(OffType where, const QByteArray &what);
 
+    QList<QByteArray> pieces(OffType start, OffType end, int maxCopy, qint64 &copied);
+    void pastePieces(OffType where, const QList<QByteArray> &pieces);
+    bool hasSharedPieces();
 
     OffType getLength();
 
@@ -979,110 +1405,163 @@ class HexDataModel;
 class HexCursor;
 
 
+// cell is a packed key: glyph in bits 0-7, alignment, frame and indices of
+// foreground and background in HexWidgetPrivate palette, everything but glyph
+// is the cell style
 class HexCellDesc {
 public:
 
     enum {
-        CENTER		= 0x000000,
-        LEFT		= 0x000100,
-        RIGHT		= 0x000200,
-        FRAME		= 0x001000,
-        INVALID		= 0x002000,
+        CENTER		= 0x000,
+        LEFT		= 0x100,
+        RIGHT		= 0x200,
+        FRAME		= 0x400,
+        FgShift		= 11,	// 5 bits
+        BgShift		= 16,	// 4 bits
+        StyleShift	= 8,
+        StyleCount	= 1 << 12
     };
 
     HexCellDesc()
-        : mParam(INVALID)
+        : mKey(0)
     {
     }
 
-    HexCellDesc(const HexCellDesc &cd)
-        : mParam(cd.mParam), mFG(cd.mFG), mBG(cd.mBG)
+    HexCellDesc(uint value, int fg, int bg)
+        : mKey(value | fg << FgShift | bg << BgShift)
     {
     }
 
-    HexCellDesc(uint param, const QColor &fg, const QColor &bg)
-        : mParam(param), mFG(fg), mBG(bg)
-    {
+    uint key() const {
+        return mKey;
     }
 
-    HexCellDesc &operator=(const HexCellDesc &cd) {
-        mParam = cd.mParam;
-        mFG = cd.mFG;
-        mBG = cd.mBG;
-        return *this;
+    uint style() const {
+        return mKey >> StyleShift;
     }
 
-    bool operator==(const HexCellDesc &cd) const {
-        return mParam == cd.mParam && mFG == cd.mFG && mBG == cd.mBG;
+    int fg() const {
+        return (mKey >> FgShift)&0x1f;
     }
 
-    uint hash() const {
-        uint h = mParam + mFG.rgba() + mBG.rgba();
-        return h;
+    int bg() const {
+        return (mKey >> BgShift)&0xf;
     }
 
-    QColor fg() const {
-        return mFG;
-    }
-
-    QColor bg() const {
-        return mBG;
-    }
-
-    void setFg(const QColor &c) {
-        mFG = c;
-    }
-
-    void setBg(const QColor &c) {
-        mBG = c;
-    }
-    void setFgBg(const QColor &fg, const QColor &bg) {
-        mFG = fg;
-        mBG = bg;
+    void setFgBg(int fg, int bg) {
+        mKey = (mKey&((1 << FgShift)-1)) | fg << FgShift | bg << BgShift;
     }
 
-
     int value() const {
-        return mParam&0xff;
+        return mKey&0xff;
     }
 
     void setValue(int v) {
-        mParam = (mParam&~(0xff|INVALID)) | v;
+        mKey = (mKey&~0xff) | v;
     }
 
     int alignment() const {
-        return mParam&0x300;
+        return mKey&0x300;
     }
 
     void setAlignment(int a) {
-        mParam = (mParam&~0x300) | a;
+        mKey = (mKey&~0x300) | a;
     }
 
     void enableFrame(bool state) {
-        if(state) mParam |= FRAME;
-        else mParam &= ~FRAME;
+        if(state) mKey |= FRAME;
+        else mKey &= ~FRAME;
     }
 
     bool frameEnabled() const {
-        return (mParam&FRAME) != 0;
+        return (mKey&FRAME) != 0;
     }
 
-    void makeInvalid() {
-        mParam = INVALID;
-    }
+private:
+    uint mKey;
+};
 
-    bool isValid() const {
-        return (mParam&INVALID) == 0;
-    }
+/////////////////////// HexGlyphCache /////////////////////////////
+
+// glyph atlas of one look (font, cell size and palette): a strip of all
+// 256 cells for every used cell style, drawn on first use of the style
+class HexGlyphAtlas {
+public:
+    enum {
+        PaletteSize = 32	// fg of HexCellDesc is 5 bit
+    };
+
+    HexGlyphAtlas(const QByteArray &key, const QFont &font, int cellSide,
+                  const QColor *palette, int colorCount);
+
+    const QByteArray &key() const {return mKey;}
+    int charHeight() const {return mCellSide;}
+    int charWidth() const {return mCellSide/2;}
 
+    QRect cellRect(const HexCellDesc &cd);
+    const QImage &image() const {return mImage;}
+    // copy of image() for QPainter, made when new strips were drawn
+    const QPixmap &pixmap();
+
+    // safe to call from worker thread as long as nobody else uses the atlas
+    void addStrips(const QList<HexCellDesc> &styles);
 
 private:
-    int mParam;
-    QColor mFG;
-    QColor mBG;
+    friend class HexGlyphCache;
+
+    int addStrip(const HexCellDesc &style);
+    void drawCell(QPainter &painter, const QRect &rect, const HexCellDesc &cd);
+
+    QByteArray mKey;
+    QFont mFont;
+    int mCellSide;
+    QColor mPalette[PaletteSize];
+
+    QImage mImage;
+    QPixmap mPixmap;
+    bool mPixmapDirty;	// mPixmap is behind mImage
+    int mStripCount;
+    short mStrips[HexCellDesc::StyleCount]; // strip of each style, -1 if not drawn
+
+    int mRefs;			// widgets drawing with the atlas
+    QFuture<void> mWarming; // background rasterization of common styles
+};
+
+// process-wide atlases shared by all widgets with the same look;
+// all methods are for GUI thread, workers only fill atlases being warmed
+class HexGlyphCache {
+public:
+    static HexGlyphCache *instance();
+
+    static QByteArray key(const QFont &font, int cellSide,
+                          const QColor *palette, int colorCount);
+
+    // atlas of the look, created if needed; pair with release()
+    HexGlyphAtlas *acquire(const QFont &font, int cellSide,
+                           const QColor *palette, int colorCount);
+    void release(HexGlyphAtlas *atlas);
+
+    // draws strips of styles in background, acquire() waits if not done yet;
+    // does nothing where fonts can't be rendered outside gui thread
+    void prewarm(const QFont &font, int cellSide, const QColor *palette,
+                 int colorCount, const QList<HexCellDesc> &styles);
+
+    int atlasCount() const {return mAtlases.size();}
+
+private:
+    HexGlyphCache() {}
+    void trim();
+
+    enum {
+        MaxUnused = 4	// atlases kept when no widget uses them
+    };
+
+    QHash<QByteArray, HexGlyphAtlas *> mAtlases;
+    QList<HexGlyphAtlas *> mUnused; // least recently used first
+
+    static HexGlyphCache *mInstance;
 };
 
-uint qHash(const HexCellDesc &cd);
 
 /////////////////////// HexWidgetPrivate /////////////////////////////
 
@@ -1091,6 +1570,30 @@ class HexWidgetPrivate : public QFrame {
 
 public:
 
+    // indices of palette colors used by HexCellDesc
+    enum ColorRole {
+        OffsetFg,
+        OffsetBg,
+        DataFgEven,
+        DataFgOdd,
+        DataBgEven,
+        DataBgOdd,
+        TextFgEven,
+        TextBgEven,
+        TextFgOdd,
+        TextBgOdd,
+        SelFg,
+        SelBg,
+        CursorFg,
+        CursorBg,
+        ZeroFg,		// byte classes, used instead of even/odd fg
+        FullFg,
+        PrintableFg,
+        ControlFg,
+        HighFg,
+        ColorCount
+    };
+
     HexWidgetPrivate(HexWidget *pub, HexDocument *document);
     ~HexWidgetPrivate();
 
@@ -1120,24 +1623,44 @@ public:
 
     int charHeight() {return mCellSide;}
     int charWidth() {return mCellSide/2;}
-    QPixmap fetchCell(const HexCellDesc &cd);
+
+    enum RenderMode {
+        PainterRender,	// cells drawn from atlas pixmap by QPainter
+        ScanlineRender	// cells copied from atlas image line by line
+    };
+
+    // glyphs come from atlas shared with other widgets of the same look
+    QRect cellRect(const HexCellDesc &cd) {return mAtlas->cellRect(cd);}
+    const QPixmap &atlas() {return mAtlas->pixmap();}
+    const QImage &atlasImage() {return mAtlas->image();}
+    // rasterizes glyphs of configured look in background, called at startup
+    static void prewarmGlyphs();
+    int renderMode() {return mRenderMode;}
+    // changed whenever colors or font are reloaded
+    int styleSerial() {return mStyleSerial;}
     int cols() {return mCols;}
     int groupCols() {return mGroupCols;}
 
-    QColor offsetFg()	{return mOffsetFg;}
-    QColor offsetBg()	{return mOffsetBg;}
-    QColor dataFgEven()	{return mDataFgEven;}
-    QColor dataBgEven()	{return mDataBgEven;}
-    QColor dataFgOdd()	{return mDataFgOdd;}
-    QColor dataBgOdd()	{return mDataBgOdd;}
-    QColor textFgEven()	{return mTextFgEven;}
-    QColor textBgEven()	{return mTextBgEven;}
-    QColor textFgOdd()	{return mTextFgOdd;}
-    QColor textBgOdd()	{return mTextBgOdd;}
-    QColor selFg()		{return mSelFg;}
-    QColor selBg()		{return mSelBg;}
-    QColor cursorFg()	{return mCursorFg;}
-    QColor cursorBg()	{return mCursorBg;}
+    QColor offsetFg()	{return mPalette[OffsetFg];}
+    QColor offsetBg()	{return mPalette[OffsetBg];}
+    QColor dataFgEven()	{return mPalette[DataFgEven];}
+    QColor dataBgEven()	{return mPalette[DataBgEven];}
+    QColor dataFgOdd()	{return mPalette[DataFgOdd];}
+    QColor dataBgOdd()	{return mPalette[DataBgOdd];}
+    QColor textFgEven()	{return mPalette[TextFgEven];}
+    QColor textBgEven()	{return mPalette[TextBgEven];}
+    QColor textFgOdd()	{return mPalette[TextFgOdd];}
+    QColor textBgOdd()	{return mPalette[TextBgOdd];}
+    QColor selFg()		{return mPalette[SelFg];}
+    QColor selBg()		{return mPalette[SelBg];}
+    QColor cursorFg()	{return mPalette[CursorFg];}
+    QColor cursorBg()	{return mPalette[CursorBg];}
+    QColor color(int role)	{return mPalette[role];}
+
+    // fg role of every byte value in even and odd columns,
+    // by byte class or by column parity
+    const uchar *dataFg(int odd) {return mDataFg[odd];}
+    const uchar *textFg(int odd) {return mTextFg[odd];}
 
 
 public slots:
@@ -1146,10 +1669,15 @@ public slots:
     void copyAsText();
     void paste();
     void pasteOver();
+    void pasteHex();
+    void pasteHexOver();
 
     bool save();
     bool saveAs();
 
+    void find();
+    void findNext();
+
 signals:
     void cellFontChanged();
     void offsetChanged(OffType offset);
@@ -1163,19 +1691,21 @@ private slots:
     void updateTitle();
     void updateActions();
     void readSettings();
+    void editCacheSettings();
+    void transformSelection();
+    void exportSelection();
+    void showFound(OffType offset);
 
 private:
     HexWidget *mPublic;
 
-    struct CharPix {
-        CharPix *prev, *next;
-        HexCellDesc cd; // hash key
-        QPixmap pix;
-    };
+    void startFind(OffType from);
 
-
-    void clearFontCache();
-    QPixmap drawFontCell(const HexCellDesc &cd);
+    static int cellSideFor(const QFont &font, int *margin);
+    static void readLook(QFont &font, QColor *palette);
+    static QList<HexCellDesc> commonStyles(bool byteClasses);
+    static int byteClass(int byte);
+    void buildByteStyles();
 
     bool mEditable;
 
@@ -1185,7 +1715,7 @@ private:
     QList<QAction *> mFileActions;
     QList<QAction *> mEditActions;
 
-    QList<HexWidgetPrivate *> mInstanceList;
+    static QList<HexWidgetPrivate *> mInstanceList;
 
     class QAction
         *saveAct,
@@ -1195,14 +1725,24 @@ private:
         *copyAsTextAct,
         *pasteAct,
         *pasteOverAct,
+        *pasteHexAct,
+        *pasteHexOverAct,
         *undoAct,
         *redoAct,
+        *cacheAct,
+        *transformAct,
+        *exportAct,
+        *findAct,
+        *findNextAct,
     ;
 
+    QByteArray mFindPattern;	// last searched bytes, for find next
+
 
     HexView *mOffsetView;
     HexView *mDataView;
     HexView *mTextView;
+    class HexMinimap *mMinimap;
 
     QFont mFont;		// font to use for drawing all stuff
     int mCellMargin;	// border margin in byte cell
@@ -1210,29 +1750,14 @@ private:
     int mCols;			// number of bytes per line
     int mGroupCols;		// number of bytes in group
 
-    QColor
-        mOffsetFg,
-        mOffsetBg,
-        mDataFgEven,
-        mDataFgOdd,
-        mDataBgEven,
-        mDataBgOdd,
-        mTextFgEven,
-        mTextBgEven,
-        mTextFgOdd,
-        mTextBgOdd,
-        mSelFg,
-        mSelBg,
-        mCursorFg,
-        mCursorBg,
-    ;
-
-    CharPix *mru;
-    CharPix *lru;
-    CharPix *pixes;
-    int mCacheSize; // number of font cells to cache
+    QColor mPalette[ColorCount];
+    int mByteClasses;	// color bytes by class instead of column parity
+    uchar mDataFg[2][256];
+    uchar mTextFg[2][256];
 
-    QHash<HexCellDesc, CharPix*> mPixHash;
+    int mStyleSerial;
+    HexGlyphAtlas *mAtlas;	// owned by HexGlyphCache
+    int mRenderMode;
 };
 
 
@@ -1260,6 +1785,13 @@ public:
     int groupCols() {return parent()->groupCols();}
     int charWidth() const {return parent()->charWidth();}
 
+    qint64 rowCacheHits() const {return mRowHits;}
+    qint64 rowCacheMisses() const {return mRowMisses;}
+    double rowCacheHitRate() const {
+        return mRowHits+mRowMisses ? (double)mRowHits/(mRowHits+mRowMisses) : 0;
+    }
+    // next paint draws every row anew; lets benchmarks time full repaints
+    void clearRowCache() {mRowCache.clear();}
 
 public slots:
     void scroll(int delta);
@@ -1269,7 +1801,10 @@ protected slots:
 
 private slots:
     void updateView();
+    void updateRange(OffType start, OffType end, OffType delta);
+    void documentChanged(OffType start, OffType end, OffType delta);
     void cursorChanged();
+    void topChanged();
 
 protected:
     bool event(QEvent *event);
@@ -1285,10 +1820,50 @@ protected:
     void moveCursor(int col, int row, bool moveAnchor=true);
 
     QRect rangeToRect(OffType start, OffType end);
+    // rect of rows in view changed by edit of [start, end), may be empty
+    QRect visibleRect(OffType start, OffType end, OffType delta);
     QPair<OffType,OffType> rectToRange(QRect rect);
+    void updateCursorCell(); // only row with cursor
+
+    // reads [start, end) of document into frame buffer reused between paints
+    const char *readFrame(OffType start, OffType end);
+
+    // draws rows of data and text views crossing dirty rectangle
+    void paintRows(QPainter &painter, const QRect &dirty, int cursorLook);
+    virtual void drawRow(QPainter &painter, OffType offset, const QByteArray &bytes,
+                         OffType selStart, OffType selEnd, int cursorLook) {}
+
+    // cells are queued and then drawn from the atlas with a single call,
+    // in scanline mode they are copied into frame image right away
+    void addCell(int x, int y, const HexCellDesc &cd);
+    void drawCells(QPainter &painter);
+
+    // rendered rows are cached under key made of everything they depend on,
+    // so edits and cursor moves simply miss for rows they touch
+    QByteArray rowKey(OffType offset, const QByteArray &bytes,
+                      OffType selStart, OffType selEnd, int cursorLook);
+    bool findRow(const QByteArray &key, QPixmap &row);
+    void insertRow(const QByteArray &key, const QPixmap &row);
 
 private:
-    bool mSelectionVisible;
+    enum {
+        RowCacheSize = 16*1024 // KiB of row pixmaps per view
+    };
+
+    QVector<QPainter::PixmapFragment> mCells;
+    QByteArray mFrame;
+    QImage mImage;		// frame image of scanline mode
+    QImage *mTarget;	// where addCell() copies cells, 0 - queue them
+    int mTargetY;		// row position in mTarget
+    QCache<QByteArray, QPixmap> mRowCache;
+    int mRowSerial;		// parent's styleSerial() rows were drawn with
+    qint64 mRowHits;
+    qint64 mRowMisses;
+    // cursor state last painted, to update only rows it leaves or enters
+    OffType mSelStart;
+    OffType mSelEnd;
+    OffType mPosition;
+    OffType mTop;		// start() of pixels currently on screen
     bool mCursorVisible;
     bool mEditable;
     HexWidgetPrivate *mParent;
@@ -1356,6 +1931,8 @@ public:
     OffType relativeToGlobal(int rel);
 
 protected:
+    void drawRow(QPainter &painter, OffType offset, const QByteArray &bytes,
+                 OffType selStart, OffType selEnd, int cursorLook);
     void mousePressEvent(QMouseEvent *e);
     void mouseReleaseEvent(QMouseEvent *e);
     void mouseMoveEvent(QMouseEvent *e);
@@ -1397,6 +1974,8 @@ public:
     OffType relativeToGlobal(int rel);
 
 protected:
+    void drawRow(QPainter &painter, OffType offset, const QByteArray &bytes,
+                 OffType selStart, OffType selEnd, int cursorLook);
     void mousePressEvent(QMouseEvent *e);
     void mouseReleaseEvent(QMouseEvent *e);
     void mouseMoveEvent(QMouseEvent *e);
@@ -1414,6 +1993,184 @@ private:
 };
 
 
+// summary of one block of document, bytes are scaled to 0..255
+struct HexBlockStats {
+    HexBlockStats() : entropy(0), zeros(0), ones(0), ascii(0), valid(false) {}
+
+    uint8_t entropy;	// 0 - constant data, 255 - 8 bits per byte
+    uint8_t zeros;		// share of 0x00 bytes
+    uint8_t ones;		// share of 0xFF bytes
+    uint8_t ascii;		// share of printable ASCII and whitespace
+    bool valid;			// false until computed
+};
+
+// blocks computed by one background job
+struct HexStatsChunk {
+    qint64 first;		// index of first block
+    int serial;			// HexOverview::mSerial when data was read
+    QVector<HexBlockStats> blocks;
+};
+
+// block summaries of whole document kept as pyramid, level 0 has finest
+// blocks and each next level merges two blocks of previous one.
+// One per document, so several views don't scan the same data.
+// Data is read on GUI thread in small chunks and summarized by QtConcurrent,
+// so data models need no locking, same as HexTransformJob.
+class HexOverview : public QObject {
+    Q_OBJECT
+
+public:
+    enum {
+        TargetBlocks = 65536,	// level 0 block size is chosen to get about that many
+        MinBlockSize = 256,
+        ChunkSize = 1024*1024,	// bytes read per job, at least one block
+        RescanDelay = 500		// ms without length changing edits before moved blocks are redone
+    };
+
+    HexOverview(HexDocument *doc, QObject *parent = 0);
+    ~HexOverview();
+
+    OffType blockSize() const {return mBlockSize;}
+    int levels() const {return mLevels.size();}
+
+    // coarsest level which blocks are not larger than size
+    int levelFor(OffType size) const;
+    // summary of block at level covering offset
+    HexBlockStats stats(int level, OffType offset) const;
+
+signals:
+    void updated();
+
+private slots:
+    void documentChanged(OffType start, OffType end, OffType delta);
+    void rescanShifted();
+    void jobDone();
+
+private:
+    // blocks [first, last) changed by edit number serial
+    struct Edit {
+        int serial;
+        qint64 first;
+        qint64 last;
+    };
+
+    void reset();
+    void addEdit(qint64 first, qint64 last);
+    void invalidate(qint64 first, qint64 last);
+    void queue(qint64 first, qint64 last);
+    void startJobs();
+    void store(const HexStatsChunk &chunk);
+
+    HexDocument *mDocument;
+    OffType mBlockSize;
+    QVector<QVector<HexBlockStats> > mLevels;
+    QList<QPair<qint64, qint64> > mPending; // [first, last) block ranges to compute
+    QHash<QFutureWatcher<HexStatsChunk> *, int> mJobs; // running jobs and mSerial they read at
+    QList<Edit> mEdits;	// edits newer than some running job, their results are stale there
+    int mSerial;		// bumped by every edit
+    qint64 mShifted;	// blocks from here hold stats of moved data till rescan, -1 if none
+    QTimer mRescanTimer;
+};
+
+// column next to text view showing whole document overview,
+// click or drag moves view, ctrl+wheel zooms
+class HexMinimap : public QWidget {
+    Q_OBJECT
+
+public:
+    HexMinimap(HexWidgetPrivate *parent);
+
+    QSize sizeHint() const;
+
+private slots:
+    void overviewUpdated();
+
+protected:
+    void paintEvent(QPaintEvent *event);
+    void mousePressEvent(QMouseEvent *e);
+    void mouseMoveEvent(QMouseEvent *e);
+    void wheelEvent(QWheelEvent *e);
+
+private:
+    enum {
+        StripeWidth = 6 // entropy, 0x00/0xFF and ASCII stripes
+    };
+
+    // part of document shown, whole document when not zoomed
+    OffType windowStart();
+    OffType windowLength();
+    OffType offsetAt(int y);
+    void moveTo(int y);
+
+    HexWidgetPrivate *mParent;
+    HexOverview *mOverview;	// owned by document
+    int mZoom;		// shown part is length/mZoom around view top
+};
+
+
+// coalesces repaints caused by document changes and presents them at most
+// frameRate() times per second; user input still repaints immediately
+class HexRepaintScheduler : public QObject {
+    Q_OBJECT
+
+public:
+    struct Stats {
+        Stats() : frames(0), coalescedRequests(0), lastFrameNsecs(0),
+                  maxFrameNsecs(0), totalFrameNsecs(0) {}
+
+        double averageFrameNsecs() const {
+            return frames ? (double)totalFrameNsecs/frames : 0;
+        }
+
+        qint64 frames;			// frames presented
+        qint64 coalescedRequests;	// requests merged into already pending frame
+        qint64 lastFrameNsecs;	// time to repaint everything in last frame
+        qint64 maxFrameNsecs;
+        qint64 totalFrameNsecs;
+    };
+
+    static HexRepaintScheduler *instance();
+
+    // rect of widget is repainted with next frame
+    void update(QWidget *widget, const QRect &rect);
+    // slot without arguments is invoked once with next frame
+    void call(QObject *receiver, const char *member);
+    // pending region of widget follows its content when it is scrolled
+    void scroll(QWidget *widget, int dx, int dy);
+
+    int frameRate() const {return mFrameRate;}
+
+    const Stats &stats() const {return mStats;}
+    void resetStats() {mStats = Stats();}
+
+private slots:
+    void frame();
+    void readSettings();
+
+private:
+    HexRepaintScheduler(QObject *parent);
+    void schedule();
+
+    struct Repaint {
+        QPointer<QWidget> widget;
+        QRegion region;
+    };
+
+    struct Call {
+        QPointer<QObject> receiver;
+        QByteArray member;
+    };
+
+    QList<Repaint> mRepaints;
+    QList<Call> mCalls;
+    QTimer mTimer;
+    QElapsedTimer mLastFrame;
+    int mFrameRate;
+    Stats mStats;
+    static HexRepaintScheduler *mInstance;
+};
+
+
 //////////////////////////////// HexSettings //////////////////////////////////////
 
 class HexSettings : public QObject {
@@ -1440,6 +2197,11 @@ public:
     static QColor defSelBg()		{return PREDEF_COLOR(Highlight);}
     static QColor defCursorFg()		{return PREDEF_COLOR(WindowText);}
     static QColor defCursorBg()		{return QColor(Qt::red);}
+    static QColor defZeroFg()		{return QColor(Qt::gray);}
+    static QColor defFullFg()		{return QColor(Qt::darkRed);}
+    static QColor defPrintableFg()	{return PREDEF_COLOR(Text);}
+    static QColor defControlFg()	{return QColor(Qt::darkGreen);}
+    static QColor defHighFg()		{return QColor(Qt::darkBlue);}
     static QFont defFont() {
 #ifdef Q_OS_WIN
         QFont font("courier");
@@ -1455,13 +2217,24 @@ public:
     static int defCols() {return 16;}
     static int defGroupCols() {return 4;}
 
+    static int defCacheSize() {return 4*1024;}		// KiB per document
+    static int defCachePageSize() {return 0;}		// 0 - data model's page size
+    static int minCachePageSize() {return 512;}	// tinier pages cost more than they save
+    static int defCacheBudget() {return 256;}		// MiB for all documents, 0 - unlimited
+    static int defUndoMemory() {return 64;}		// MiB for all documents, 0 - unlimited
+    static int defTextFormat() {return 1;}			// HexTextEncoder::HexPairs
+    static int defFrameRate() {return 60;}			// repaints per second on document changes
+    static int defRenderMode() {return 0;}			// HexWidgetPrivate::PainterRender
+    static int defByteClasses() {return 0;}			// color bytes by column parity
+
+    // makes widgets and documents reread their keys from QSettings
+    void emitChanged();
 
 signals:
     void changed();
 
 private:
     HexSettings(QObject *parent);
-    void emitChanged();
     void readSettings();
 
     friend class HexSettingsPanel;
@@ -1572,6 +2345,14 @@ private slots:
     void editFont();
     void setCols(int cols);
     void setGroupCols(int groupCols);
+    void setCacheSize(int cacheSize);
+    void setCachePageSize(int pageSize);
+    void setCacheBudget(int budget);
+    void setUndoMemory(int undoMemory);
+    void setTextFormat(int textFormat);
+    void setFrameRate(int frameRate);
+    void setRenderMode(int renderMode);
+    void setByteClasses(bool state);
 
 private:
     QIcon iconForColor(const QColor &c);
@@ -1601,11 +2382,24 @@ private:
         mSelBg,
         mCursorFg,
         mCursorBg,
+        mZeroFg,
+        mFullFg,
+        mPrintableFg,
+        mControlFg,
+        mHighFg,
     ;
 
     QFont mFont;
     int mCols;
     int mGroupCols;
+    int mCacheSize;
+    int mCachePageSize;
+    int mCacheBudget;
+    int mUndoMemory;
+    int mTextFormat;
+    int mFrameRate;
+    int mRenderMode;
+    int mByteClasses;
 
 
     ColorPicker *mColorPicker;
@@ -1809,6 +2603,14 @@ public:
     HexUndoCommand(const QString &text)
     {
         setText(text);
+        mDocument = 0;
+        mListed = false;
+        mAccounted = 0;
+    }
+
+    virtual ~HexUndoCommand() {
+        mTotalUsage -= mAccounted;
+        if(mListed) mInstances.erase(mInstance);
     }
 
     HexDocument *document() {
@@ -1817,25 +2619,46 @@ public:
 
     void setDocument(HexDocument *doc) {
         mDocument = doc;
+        mInstance = mInstances.insert(mInstances.end(), this);
+        mListed = true;
+    }
+
+    // bytes kept in memory by this command
+    virtual qint64 memoryUsage() {
+        return 0;
+    }
+
+    // brings running total up to date after redo, undo, merge or spill
+    void account() {
+        qint64 usage = memoryUsage();
+        mTotalUsage += usage-mAccounted;
+        mAccounted = usage;
+    }
+
+    // move saved data to disk
+    virtual void spill(HexUndoStore *store) {
     }
 
+    // spills oldest commands of all documents until they fit into limit
+    static void limitMemory(qint64 limit);
+
     void del(OffType start, OffType end) {
         document()->del(start, end);
     }
 
-    QByteArray cut(OffType start, OffType end) {
-        return document()->cut(start, end);
+    void cut(OffType start, OffType end, HexUndoData &data) {
+        document()->cut(start, end, data);
     }
 
-    QByteArray copy(OffType start, OffType end) {
-        return document()->copy(start, end);
+    void take(OffType start, OffType end, HexUndoData &data) {
+        document()->take(start, end, data);
     }
 
-    QByteArray copyAsText(OffType start, OffType end) {
-        return document()->copyAsText(start, end);
+    void capture(OffType start, OffType end, HexUndoData &data) {
+        document()->capture(start, end, data);
     }
 
-    void paste(OffType where, const QByteArray &what) {
+    void paste(OffType where, const HexUndoData &what) {
         document()->paste(where, what);
     }
 
@@ -1843,8 +2666,16 @@ public:
         document()->pasteOver(where, what);
     }
 
-    uint8_t replaceByte(OffType where, uint8_t with) {
-        return document()->replaceByte(where, with);
+    void pasteOver(OffType where, const HexUndoData &what) {
+        document()->pasteOver(where, what);
+    }
+
+    QByteArray read(OffType start, OffType end) {
+        return document()->read(start, end);
+    }
+
+    QByteArray replaceBytes(OffType where, const QByteArray &with) {
+        return document()->replaceBytes(where, with);
     }
 
     void saveCursor() {
@@ -1860,6 +2691,13 @@ private:
     HexDocument *mDocument;
     OffType mAnchor;
     OffType mPosition;
+
+    bool mListed;
+    QLinkedList<HexUndoCommand*>::iterator mInstance; // for O(1) removal
+    qint64 mAccounted;	// memoryUsage() included in mTotalUsage
+
+    static QLinkedList<HexUndoCommand*> mInstances; // in push order
+    static qint64 mTotalUsage;	// bytes kept by all commands
 };
 
 class HexCut : public HexUndoCommand {
@@ -1873,18 +2711,26 @@ public:
     virtual void undo() {
         saveCursor();
         paste(mStart, mData);
-        mData = QByteArray();
+        mData.clear();
     }
 
     virtual void redo() {
-        mData = cut(mStart, mEnd);
+        cut(mStart, mEnd, mData);
         restoreCursor();
     }
 
+    virtual qint64 memoryUsage() {
+        return mData.memoryUsage();
+    }
+
+    virtual void spill(HexUndoStore *store) {
+        mData.spill(store);
+    }
+
 private:
     OffType mStart;
     OffType mEnd;
-    QByteArray mData;
+    HexUndoData mData;
 };
 
 class HexDel : public HexUndoCommand {
@@ -1897,25 +2743,32 @@ public:
 
     virtual void redo() {
         saveCursor();
-        mData = copy(mStart, mEnd);
-        del(mStart, mEnd);
+        take(mStart, mEnd, mData);
     }
 
     virtual void undo() {
         paste(mStart, mData);
-        mData = QByteArray();
+        mData.clear();
         restoreCursor();
     }
 
+    virtual qint64 memoryUsage() {
+        return mData.memoryUsage();
+    }
+
+    virtual void spill(HexUndoStore *store) {
+        mData.spill(store);
+    }
+
 private:
     OffType mStart;
     OffType mEnd;
-    QByteArray mData;
+    HexUndoData mData;
 };
 
 class HexPasteOver : public HexUndoCommand {
 public:
-    HexPasteOver(OffType where, QByteArray what)
+    HexPasteOver(OffType where, const HexUndoData &what)
             : HexUndoCommand("paste over"),
             mStart(where), mEnd(where+what.size()), mWhat(what)
     {
@@ -1923,27 +2776,38 @@ public:
 
     virtual void redo() {
         saveCursor();
-        QByteArray save = copy(mStart, mEnd);
-        pasteOver(mStart, mWhat);
-        mWhat = save;
+        swap();
     }
 
     virtual void undo() {
-        QByteArray save = copy(mStart, mEnd);
-        pasteOver(mStart, mWhat);
-        mWhat = save;
+        swap();
         restoreCursor();
     }
 
+    virtual qint64 memoryUsage() {
+        return mWhat.memoryUsage();
+    }
+
+    virtual void spill(HexUndoStore *store) {
+        mWhat.spill(store);
+    }
+
 private:
+    void swap() {
+        HexUndoData save;
+        capture(mStart, mEnd, save);
+        pasteOver(mStart, mWhat);
+        mWhat = save;
+    }
+
     OffType mStart;
     OffType mEnd;
-    QByteArray mWhat;
+    HexUndoData mWhat;
 };
 
 class HexPaste : public HexUndoCommand {
 public:
-    HexPaste(OffType where, QByteArray what)
+    HexPaste(OffType where, const HexUndoData &what)
             : HexUndoCommand("paste"),
             mStart(where), mEnd(where+what.size()), mWhat(what)
     {
@@ -1952,44 +2816,255 @@ public:
     virtual void redo() {
         saveCursor();
         paste(mStart, mWhat);
-        mWhat = QByteArray();
+        mWhat.clear();
+    }
+
+    virtual void undo() {
+        take(mStart, mEnd, mWhat);
+        restoreCursor();
+    }
+
+    virtual qint64 memoryUsage() {
+        return mWhat.memoryUsage();
+    }
+
+    virtual void spill(HexUndoStore *store) {
+        mWhat.spill(store);
+    }
+
+private:
+    OffType mStart;
+    OffType mEnd;
+    HexUndoData mWhat;
+};
+
+// consecutive byte edits (typing, patching) are merged into one command
+class HexReplaceBytes : public HexUndoCommand {
+public:
+    enum {
+        Id = 1,
+        MaxSize = HexUndoData::ChunkSize // don't grow single command beyond that
+    };
+
+    HexReplaceBytes(OffType where, uint8_t with)
+            : HexUndoCommand("replace bytes"),
+            mStart(where), mNew(1, (char)with)
+    {
+    }
+
+    virtual int id() const {
+        return Id;
+    }
+
+    // other command is already applied, so we only absorb its bytes
+    virtual bool mergeWith(const QUndoCommand *command) {
+        const HexReplaceBytes *other = static_cast<const HexReplaceBytes*>(command);
+        if(other->mStart < mStart || other->mStart > mStart+mNew.size())
+            return false;
+        if(other->mStart+other->mNew.size() > mStart+MaxSize)
+            return false;
+
+        int at = other->mStart-mStart;
+        for(int i = 0; i < other->mNew.size(); i++, at++) {
+            if(at < mNew.size()) {
+                mNew[at] = other->mNew[i]; // keep our original byte in mOld
+            } else {
+                mNew.append(other->mNew[i]);
+                mOld.append(other->mOld[i]);
+            }
+        }
+        return true;
+    }
+
+    virtual void redo() {
+        saveCursor();
+        mOld = replaceBytes(mStart, mNew);
     }
 
     virtual void undo() {
-        mWhat = copy(mStart, mEnd);
-        del(mStart, mEnd);
+        replaceBytes(mStart, mOld);
         restoreCursor();
     }
 
+    virtual qint64 memoryUsage() {
+        return mOld.size() + mNew.size();
+    }
+
+private:
+    OffType mStart;
+    QByteArray mOld;
+    QByteArray mNew;
+};
+
+
+// in place transform of selected bytes
+struct HexTransform {
+    enum Op {
+        Fill,		// repeat key
+        Xor,		// xor with repeated key
+        Add,		// add repeated key bytewise
+        Rotate,		// rotate each byte left by bits
+        Swap16,		// reverse byte order of 16, 32 and 64 bit words
+        Swap32,
+        Swap64
+    };
+
+    HexTransform(Op inOp = Fill, const QByteArray &inKey = QByteArray(), int inBits = 0)
+        : op(inOp), key(inKey), bits(inBits) {
+    }
+
+    QString name() const;
+
+    // phase is offset of data from start of transformed range, it keeps
+    // key aligned between chunks; swaps leave incomplete trailing word as is
+    void apply(uint8_t *data, int size, OffType phase) const;
+
+    Op op;
+    QByteArray key;
+    int bits;
+};
+
+class QProgressDialog;
+
+// streams range through transform chunk by chunk: chunks are read and
+// written on GUI thread while kernel works on previous one in thread pool
+class HexTransformJob : public QObject {
+    Q_OBJECT
+
+public:
+    HexTransformJob(HexDocument *doc, OffType start, OffType end,
+                    const HexTransform &transform, QWidget *parent = 0);
+    ~HexTransformJob();
+
+    void start();
+
+private slots:
+    void chunkDone();
+    void cancel();
+
 private:
+    void readNext(OffType offset);
+    void runNext();
+    void finish();
+    void rollback();
+
+    HexDocument *mDocument;
+    HexTransform mTransform;
     OffType mStart;
     OffType mEnd;
-    QByteArray mWhat;
+    OffType mOffset;		// start of chunk being transformed
+    QByteArray mNext;		// prefetched chunk
+    HexUndoData mOld;		// original bytes of all chunks read
+    QFutureWatcher<QByteArray> mWatcher;
+    QProgressDialog *mProgress;
+    bool mCancelled;
 };
 
-class HexReplaceByte : public HexUndoCommand {
+class HexTransformBytes : public HexUndoCommand {
 public:
-    HexReplaceByte(OffType where, uint8_t with)
-            : HexUndoCommand("replace byte"),
-            mWhere(where), mWith(with)
+    // bytes are already transformed by HexTransformJob, old holds originals
+    HexTransformBytes(OffType start, OffType end, const HexTransform &transform,
+                      const HexUndoData &old)
+            : HexUndoCommand(transform.name()),
+            mStart(start), mEnd(end), mTransform(transform), mOld(old), mApplied(true)
     {
     }
 
     virtual void redo() {
         saveCursor();
-        mWith = replaceByte(mWhere, mWith);
+        if(mApplied) {
+            mApplied = false;
+            return;
+        }
+
+        for(OffType offset = mStart; offset < mEnd; offset += HexUndoData::ChunkSize) {
+            QByteArray chunk = read(offset, qMin(mEnd, offset+HexUndoData::ChunkSize));
+            mTransform.apply((uint8_t*)chunk.data(), chunk.size(), offset-mStart);
+            pasteOver(offset, chunk);
+        }
     }
 
     virtual void undo() {
-        mWith = replaceByte(mWhere, mWith);
+        pasteOver(mStart, mOld);
         restoreCursor();
     }
 
+    virtual qint64 memoryUsage() {
+        return mOld.memoryUsage();
+    }
+
+    virtual void spill(HexUndoStore *store) {
+        mOld.spill(store);
+    }
+
 private:
-    OffType mWhere;
-    uint8_t mWith;
+    OffType mStart;
+    OffType mEnd;
+    HexTransform mTransform;
+    HexUndoData mOld;
+    bool mApplied;
+};
+
+// byte sequence search: SSE2 compares first and last pattern byte at 16
+// positions at once and only candidates are verified, Horspool handles
+// long patterns, tails and builds without SSE2
+struct HexSearch {
+    enum {
+        MaxFilterSize = 32	// longer patterns skip faster with Horspool
+    };
+
+    HexSearch(const QByteArray &inPattern = QByteArray());
+
+    int size() const {return pattern.size();}
+
+    // index of first match in data, -1 if none
+    int find(const uint8_t *data, int size) const;
+    int horspool(const uint8_t *data, int from, int size) const;
+
+    QByteArray pattern;
+    int skip[256];		// shift by last byte of window
 };
 
+// searches document from start to its end chunk by chunk: chunks are read
+// on GUI thread while previous one is searched in thread pool, consecutive
+// chunks overlap by pattern size - 1 so matches across boundary are found
+class HexFindJob : public QObject {
+    Q_OBJECT
+
+public:
+    enum {
+        ChunkSize = 4*1024*1024
+    };
+
+    HexFindJob(HexDocument *doc, OffType start, const HexSearch &search, QWidget *parent = 0);
+    ~HexFindJob();
+
+    void start();
+
+signals:
+    // offset of match, -1 if there is none; not emitted when cancelled
+    void found(OffType offset);
+
+private slots:
+    void chunkDone();
+    void cancel();
+
+private:
+    void readNext(OffType offset);
+    void runNext();
+    void finish(OffType offset);
+
+    HexDocument *mDocument;
+    HexSearch mSearch;
+    OffType mStart;
+    OffType mEnd;
+    OffType mOffset;		// start of chunk being searched
+    int mChunkSize;			// size of chunk being searched
+    QByteArray mNext;		// prefetched chunk
+    QFutureWatcher<int> mWatcher;
+    QProgressDialog *mProgress;
+    bool mCancelled;
+};
 
 
 class BasicFileAccess : public HexPlugin {
@@ -2005,6 +3080,7 @@ private slots:
     void openFile();
     void loadFile();
     void loadTextFile();
+    void recoverJournals();
 
 private:
     HexEd *mEd;
@@ -2049,6 +3125,7 @@ public slots:
     void updateModel();
 
 private slots:
+    void documentChanged(OffType start, OffType end, OffType delta);
     void documentDestroyed(QObject *obj);
 
 private:
@@ -7,7 +7,7 @@
 ################################################################
 
 QT       += core gui
-greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets concurrent
 TEMPLATE = app
 
 #don't create bundle on OSX